@@ -8,6 +8,12 @@
 
 using t_GenericConstructor = void (*)(void *that);
 using t_sendMsgToSmc = UInt32 (*)(void *smum, UInt32 msgId);
+using t_sendMsgToSmcWithParameter = UInt32 (*)(void *smum, UInt32 msgId, UInt32 param);
+using t_cgsReadIndRegister = UInt32 (*)(void *cgsDevice, UInt32 space, UInt32 index);
+using t_cgsWriteIndRegister = void (*)(void *cgsDevice, UInt32 space, UInt32 index, UInt32 value);
+
+//! amdgpu's `enum cgs_ind_reg`
+constexpr UInt32 CGS_IND_REG__SMC = 2;
 
 constexpr UInt32 AMDGPU_FAMILY_CZ = 0x87;
 constexpr UInt32 AMDGPU_FAMILY_KV = 0x7D;
@@ -29,10 +35,27 @@ constexpr UInt64 APU_COMMON_VRAM_PADDR = 0xF400000000;
 //! top paddr:    0xFF3FFFFFFF (1024M)
 constexpr UInt64 APU_COMMON_GART_PADDR = 0xFF00000000;
 
+//! The GART may grow up to the end of the 40-bit MC address space without moving its base
+constexpr UInt64 APU_MAX_GART_SIZE = (1ULL << 40) - APU_COMMON_GART_PADDR;
+constexpr UInt64 APU_MIN_GART_SIZE = 256 << 20;
+
 constexpr UInt64 AGP_DISABLE_ADDR = 0xFFFFFFFF;
 
 constexpr UInt32 AMDGPU_MAX_USEC_TIMEOUT = 100000;
 
+//-------- SMU 7 Registers --------//
+
+constexpr UInt32 mmSMC_MESSAGE_0 = 0x94;
+constexpr UInt32 mmSMC_RESP_0 = 0x95;
+constexpr UInt32 mmSMC_MSG_ARG_0 = 0xA4;
+
+constexpr UInt32 ixKV_THM_TCON_CUR_TMP = 0xC0300E0C;
+
+//! See radeon's cikd.h
+constexpr UInt32 ixKV_TARGET_AND_CURRENT_PROFILE_INDEX = 0xC0200038;
+constexpr UInt32 TARGET_AND_CURRENT_PROFILE_INDEX__CURR_SCLK_INDEX_MASK = 0x1F0000;
+constexpr UInt32 TARGET_AND_CURRENT_PROFILE_INDEX__CURR_SCLK_INDEX__SHIFT = 0x10;
+
 //-------- SMU 8 Registers --------//
 
 constexpr UInt32 mmMP1_SMN_C2PMSG_90 = 0x29A;
@@ -42,6 +65,10 @@ constexpr UInt32 mmMP1_SMN_C2PMSG_66 = 0x282;
 constexpr UInt32 mmMP0PUB_IND_INDEX = 0x180;
 constexpr UInt32 mmMP0PUB_IND_DATA = 0x181;
 
+constexpr UInt32 ixTHM_TCON_CUR_TMP = 0xD8200CA4;
+constexpr UInt32 THM_TCON_CUR_TMP__CUR_TEMP_RANGE_SEL_MASK = 0x80000;
+constexpr UInt32 THM_TCON_CUR_TMP__CUR_TEMP__SHIFT = 0x15;
+
 //-------- BIF 4.1/BIF 5 Registers --------//
 
 constexpr UInt32 mmPCIE_INDEX_2 = 0xC;
@@ -51,13 +78,22 @@ constexpr UInt32 mmCONFIG_MEMSIZE = 0x150A;
 constexpr UInt32 mmCONFIG_APER_SIZE = 0x150C;    //! Why does AMDGPU not use this?
 
 constexpr UInt32 mmINTERRUPT_CNTL = 0x151A;
+constexpr UInt32 INTERRUPT_CNTL__IH_DUMMY_RD_OVERRIDE_MASK = 0x1;
+constexpr UInt32 INTERRUPT_CNTL__IH_REQ_NONSNOOP_EN_MASK = 0x8;
 constexpr UInt32 mmINTERRUPT_CNTL2 = 0x151B;
 
+constexpr UInt32 mmCC_DRM_ID_STRAPS = 0x1559;
+constexpr UInt32 CC_DRM_ID_STRAPS__ATI_REV_ID_MASK = 0xF0000000;
+constexpr UInt32 CC_DRM_ID_STRAPS__ATI_REV_ID__SHIFT = 0x1C;
+
 //-------- GFX 7/GFX 8 Registers --------//
 
 constexpr UInt32 mmCHUB_CONTROL = 0x619;
 constexpr UInt32 bypassVM = (1 << 0);
 
+constexpr UInt32 mmGRBM_STATUS = 0x2004;
+constexpr UInt32 GRBM_STATUS__GUI_ACTIVE_MASK = 0x80000000;
+
 constexpr UInt32 mmSRBM_STATUS = 0x394;
 
 constexpr UInt32 SRBM_STATUS__MCB_BUSY_MASK = 0x200;
@@ -69,6 +105,86 @@ constexpr UInt32 mmSRBM_SOFT_RESET = 0x398;
 
 constexpr UInt32 SRBM_SOFT_RESET__SOFT_RESET_MC_MASK = 0x800;
 
+constexpr UInt32 mmCC_GC_SHADER_ARRAY_CONFIG = 0x226F;
+constexpr UInt32 mmGC_USER_SHADER_ARRAY_CONFIG = 0x2270;
+constexpr UInt32 SHADER_ARRAY_CONFIG__INACTIVE_CUS_MASK = 0xFFFF0000;
+constexpr UInt32 SHADER_ARRAY_CONFIG__INACTIVE_CUS__SHIFT = 0x10;
+
+constexpr UInt32 mmGRBM_GFX_INDEX = 0xC200;
+constexpr UInt32 GRBM_GFX_INDEX__SH_INDEX__SHIFT = 0x8;
+constexpr UInt32 GRBM_GFX_INDEX__SE_INDEX__SHIFT = 0x10;
+constexpr UInt32 GRBM_GFX_INDEX__SH_BROADCAST_WRITES_MASK = 0x20000000;
+constexpr UInt32 GRBM_GFX_INDEX__INSTANCE_BROADCAST_WRITES_MASK = 0x40000000;
+constexpr UInt32 GRBM_GFX_INDEX__SE_BROADCAST_WRITES_MASK = 0x80000000;
+
+constexpr UInt32 GFX_MAX_SE = 4;
+constexpr UInt32 GFX_MAX_SH_PER_SE = 2;
+
+constexpr UInt32 mmCC_RB_BACKEND_DISABLE = 0x263D;
+constexpr UInt32 mmGC_USER_RB_BACKEND_DISABLE = 0x26DF;
+constexpr UInt32 RB_BACKEND_DISABLE__BACKEND_DISABLE_MASK = 0xFF0000;
+constexpr UInt32 RB_BACKEND_DISABLE__BACKEND_DISABLE__SHIFT = 0x10;
+
+constexpr UInt32 mmPA_SC_RASTER_CONFIG = 0xA0D4;
+constexpr UInt32 PA_SC_RASTER_CONFIG__RB_MAP_PKR0_MASK = 0x3;
+constexpr UInt32 PA_SC_RASTER_CONFIG__RB_MAP_PKR0__SHIFT = 0x0;
+constexpr UInt32 PA_SC_RASTER_CONFIG__RB_MAP_PKR1_MASK = 0xC;
+constexpr UInt32 PA_SC_RASTER_CONFIG__RB_MAP_PKR1__SHIFT = 0x2;
+constexpr UInt32 PA_SC_RASTER_CONFIG__PKR_MAP_MASK = 0x300;
+constexpr UInt32 PA_SC_RASTER_CONFIG__PKR_MAP__SHIFT = 0x8;
+constexpr UInt32 PA_SC_RASTER_CONFIG__SE_MAP_MASK = 0x3000000;
+constexpr UInt32 PA_SC_RASTER_CONFIG__SE_MAP__SHIFT = 0x18;
+constexpr UInt32 mmPA_SC_RASTER_CONFIG_1 = 0xA0D5;
+constexpr UInt32 PA_SC_RASTER_CONFIG_1__SE_PAIR_MAP_MASK = 0x3;
+constexpr UInt32 PA_SC_RASTER_CONFIG_1__SE_PAIR_MAP__SHIFT = 0x0;
+
+constexpr UInt32 PACKET3_SET_CONTEXT_REG = 0x69;
+constexpr UInt32 PACKET3_SET_CONTEXT_REG_START = 0xA000;
+
+//! Shared by the RB_MAP, PKR_MAP, SE_MAP and SE_PAIR_MAP fields
+constexpr UInt32 RASTER_CONFIG_MAP_0 = 0;
+constexpr UInt32 RASTER_CONFIG_MAP_3 = 3;
+
+constexpr UInt32 mmGB_ADDR_CONFIG = 0x263E;
+constexpr UInt32 GB_ADDR_CONFIG__NUM_PIPES_MASK = 0x7;
+constexpr UInt32 GB_ADDR_CONFIG__NUM_PIPES__SHIFT = 0x0;
+constexpr UInt32 GB_ADDR_CONFIG__PIPE_INTERLEAVE_SIZE_MASK = 0x70;
+constexpr UInt32 GB_ADDR_CONFIG__PIPE_INTERLEAVE_SIZE__SHIFT = 0x4;
+constexpr UInt32 GB_ADDR_CONFIG__NUM_SHADER_ENGINES_MASK = 0x3000;
+constexpr UInt32 GB_ADDR_CONFIG__NUM_SHADER_ENGINES__SHIFT = 0xC;
+constexpr UInt32 GB_ADDR_CONFIG__ROW_SIZE_MASK = 0x30000000;
+constexpr UInt32 GB_ADDR_CONFIG__ROW_SIZE__SHIFT = 0x1C;
+
+constexpr UInt32 mmCP_ME_CNTL = 0x21B6;
+constexpr UInt32 CP_ME_CNTL__PFP_HALT_MASK = 0x4000000;
+constexpr UInt32 CP_ME_CNTL__ME_HALT_MASK = 0x10000000;
+constexpr UInt32 mmCP_RB0_BASE = 0x3040;
+constexpr UInt32 mmCP_RB0_WPTR = 0x3045;
+constexpr UInt32 mmCP_RB_DOORBELL_CONTROL = 0x3059;
+constexpr UInt32 CP_RB_DOORBELL_CONTROL__DOORBELL_OFFSET_MASK = 0x7FFFFC;
+constexpr UInt32 CP_RB_DOORBELL_CONTROL__DOORBELL_OFFSET__SHIFT = 0x2;
+constexpr UInt32 CP_RB_DOORBELL_CONTROL__DOORBELL_EN_MASK = 0x40000000;
+
+//-------- SDMA 2.0/SDMA 3.0 Registers --------//
+
+constexpr UInt32 mmSDMA0_F32_CNTL = 0x3412;
+constexpr UInt32 SDMA0_F32_CNTL__HALT_MASK = 0x1;
+constexpr UInt32 mmSDMA0_GFX_RB_BASE = 0x3481;
+constexpr UInt32 mmSDMA0_GFX_RB_WPTR = 0x3484;
+constexpr UInt32 mmSDMA0_GFX_DOORBELL = 0x3492;
+constexpr UInt32 mmSDMA1_F32_CNTL = 0x3612;
+constexpr UInt32 mmSDMA1_GFX_RB_BASE = 0x3681;
+constexpr UInt32 mmSDMA1_GFX_RB_WPTR = 0x3684;
+constexpr UInt32 mmSDMA1_GFX_DOORBELL = 0x3692;
+constexpr UInt32 SDMA0_GFX_DOORBELL__OFFSET_MASK = 0x1FFFFF;
+constexpr UInt32 SDMA0_GFX_DOORBELL__OFFSET__SHIFT = 0x0;
+constexpr UInt32 SDMA0_GFX_DOORBELL__ENABLE_MASK = 0x10000000;
+
+//! Doorbell aperture slots, see amdgpu's `AMDGPU_DOORBELL_*` for VI
+constexpr UInt32 AMDGPU_DOORBELL_GFX_RING0 = 0x20;
+constexpr UInt32 AMDGPU_DOORBELL_SDMA_ENGINE0 = 0x1E0;
+constexpr UInt32 AMDGPU_DOORBELL_SDMA_ENGINE1 = 0x1E1;
+
 //-------- GMC Registers --------//
 
 constexpr UInt32 mmVM_CONTEXT0_PROTECTION_FAULT_DEFAULT_ADDR = 0x546;
@@ -81,6 +197,12 @@ constexpr UInt32 mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR = 0x80E;
 constexpr UInt32 mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR = 0x80F;
 constexpr UInt32 mmMC_VM_FB_OFFSET = 0x81A;
 
+constexpr UInt32 mmMC_ARB_RAMCFG = 0x9D8;
+constexpr UInt32 MC_ARB_RAMCFG__NOOFBANK_MASK = 0x3;
+constexpr UInt32 MC_ARB_RAMCFG__NOOFBANK__SHIFT = 0x0;
+constexpr UInt32 MC_ARB_RAMCFG__NOOFRANKS_MASK = 0x4;
+constexpr UInt32 MC_ARB_RAMCFG__NOOFRANKS__SHIFT = 0x2;
+
 constexpr UInt32 mmVM_CONTEXT0_PAGE_TABLE_START_ADDR = 0x557;
 constexpr UInt32 mmVM_CONTEXT1_PAGE_TABLE_START_ADDR = 0x558;
 constexpr UInt32 mmVM_CONTEXT0_PAGE_TABLE_END_ADDR = 0x55F;
@@ -90,16 +212,31 @@ constexpr UInt32 mmVM_CONTEXT1_PAGE_TABLE_END_ADDR = 0x560;
 
 constexpr UInt32 mmIH_RB_CNTL = 0xE30;
 constexpr UInt32 IH_RB_CNTL__RB_ENABLE = 0x00000001;
+constexpr UInt32 IH_RB_CNTL__WPTR_WRITEBACK_ENABLE = 0x00000100;
+constexpr UInt32 IH_RB_CNTL__WPTR_WRITEBACK_TIMER_MASK = 0x00003E00;
+constexpr UInt32 IH_RB_CNTL__WPTR_WRITEBACK_TIMER__SHIFT = 0x9;
+constexpr UInt32 IH_RB_CNTL__WPTR_OVERFLOW_ENABLE = 0x00010000;
+constexpr UInt32 IH_RB_CNTL__WPTR_OVERFLOW_CLEAR = 0x80000000;
 constexpr UInt32 mmIH_RB_BASE = 0xE31;
 constexpr UInt32 mmIH_RB_RPTR = 0xE32;
 constexpr UInt32 mmIH_RB_WPTR = 0xE33;
+constexpr UInt32 IH_RB_WPTR__RB_OVERFLOW = 0x00000001;
+constexpr UInt32 IH_RB_WPTR__OFFSET_MASK = 0x0003FFFC;
 constexpr UInt32 mmIH_RB_WPTR_ADDR_HI = 0xE34;
+constexpr UInt32 IH_RB_WPTR_ADDR_HI__ADDR_MASK = 0xFF;
 constexpr UInt32 mmIH_RB_WPTR_ADDR_LO = 0xE35;
 constexpr UInt32 mmIH_CNTL = 0xE36;
 constexpr UInt32 IH_CNTL__ENABLE_INTR = 0x00000001;
+constexpr UInt32 IH_CNTL__RPTR_REARM = 0x00000010;
+constexpr UInt32 IH_CNTL__MC_WRREQ_CREDIT_MASK = 0x000F8000;
+constexpr UInt32 IH_CNTL__MC_WRREQ_CREDIT__SHIFT = 0xF;
+constexpr UInt32 IH_CNTL__MC_WR_CLEAN_CNT_MASK = 0x01F00000;
+constexpr UInt32 IH_CNTL__MC_WR_CLEAN_CNT__SHIFT = 0x14;
 constexpr UInt32 mmIH_LEVEL_STATUS = 0xE37;
 constexpr UInt32 mmIH_STATUS = 0xE38;
 
+constexpr UInt32 IH_IV_ENTRY_SIZE = 16;
+
 //-------- AMD Catalyst Data Types --------//
 
 struct CAILASICGoldenRegisterSettings {
@@ -34,6 +34,21 @@ struct ATOMCommonTableHeader {
 constexpr UInt32 ATOM_ROM_TABLE_PTR = 0x48;
 constexpr UInt32 ATOM_ROM_DATA_PTR = 0x20;
 
+//! Master data table indices
+constexpr UInt32 ATOM_DATA_TABLE_GFX_INFO = 14;
+constexpr UInt32 ATOM_DATA_TABLE_INTEGRATED_SYSTEM_INFO = 30;
+
+struct ATOMGFXInfoV2_1 : public ATOMCommonTableHeader {
+    UInt8 gfxIpMinVer;
+    UInt8 gfxIpMajVer;
+    UInt8 maxShaderEngines;
+    UInt8 maxTilePipes;
+    UInt8 maxCUPerSH;
+    UInt8 maxSHPerSE;
+    UInt8 maxBackendsPerSE;
+    UInt8 maxTextureChannelCaches;
+} PACKED;
+
 struct IGPSystemInfoV11 : public ATOMCommonTableHeader {
     UInt32 vbiosMisc;
     UInt32 gpuCapInfo;
@@ -54,6 +69,36 @@ struct IGPSystemInfoV11 : public ATOMCommonTableHeader {
     UInt8 umaChannelCount;
 } PACKED;
 
+//! Common prefix of ATOM_INTEGRATED_SYSTEM_INFO_V1_8 (Kaveri/Kabini) and V1_9 (Carrizo/Stoney)
+struct IGPSystemInfoV1_8 : public ATOMCommonTableHeader {
+    UInt32 bootUpEngineClock;
+    UInt32 dentistVCOFreq;
+    UInt32 bootUpUMAClock;
+    UInt32 dispClkVoltage[8];
+    UInt32 bootUpReqDisplayVector;
+    UInt32 vbiosMisc;
+    UInt32 gpuCapInfo;
+    UInt32 dispClk2Freq;
+    UInt16 requestedPWMFreqInHz;
+    UInt8 htcTmpLmt;
+    UInt8 htcHystLmt;
+    UInt32 _reserved2;
+    UInt32 systemConfig;
+    UInt32 cpuCapInfo;
+    UInt32 _reserved3;
+    UInt16 gpuReservedSysMemSize;
+    UInt16 extDispConnInfoOffset;
+    UInt16 panelRefreshRateRange;
+    UInt8 memoryType;    //! IGPMemoryType in the low nibble
+    UInt8 umaChannelCount;
+} PACKED;
+static_assert(__builtin_offsetof(IGPSystemInfoV1_8, memoryType) == 90, "IntegratedSystemInfo V1_8 layout");
+
+enum IGPMemoryType : UInt8 {
+    kIGPDDR3MemType = 3,
+    kIGPDDR4MemType = 4,
+};
+
 enum DMIT17MemType : UInt8 {
     kDDR2MemType = 0x13,
     kDDR2FBDIMMMemType,
@@ -0,0 +1,190 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+
+//! GFX core codenames
+enum struct ChipType : UInt32 {
+    Spectre = 0,    //! Kaveri
+    Spooky,         //! Kaveri 2? downgraded from Spectre core
+    Kalindi,        //! Kabini/Bhavani
+    Godavari,       //! Mullins
+    Carrizo,
+    Stoney,
+    Unknown,
+};
+
+//! Front-end consumer names, includes non-consumer names as-well
+enum struct ChipVariant : UInt32 {
+    Kaveri = 0,
+    Kabini,
+    Temash,
+    Bhavani,
+    Mullins,
+    Carrizo,
+    Bristol,    //! Bristol is actually just a Carrizo+, hence why it isn't in ChipType
+    Stoney,
+    Unknown,
+};
+
+static const char *chipTypeNames[] = {"Spectre", "Spooky", "Kalindi", "Godavari", "Carrizo", "Stoney", "Unknown"};
+static const char *chipVariantNames[] = {"Kaveri", "Kabini", "Temash", "Bhavani", "Mullins", "Carrizo", "Bristol",
+    "Stoney", "Unknown"};
+
+//! Where the internal revision of the chip comes from
+enum struct RevisionSource : UInt32 {
+    None = 0,
+    Straps,    //! CC_DRM_ID_STRAPS.ATI_REV_ID
+    SMU,       //! SMU8 fuses
+};
+
+//! amdgpu's `AMD_PG_SUPPORT_*` flags we use, each maps to a `CAIL,CAIL_Disable*PowerGating` property
+enum PowerGating : UInt32 {
+    PowerGatingGfx = (1U << 0),            //! GFX_PG
+    PowerGatingGfxStaticMG = (1U << 1),    //! GFX_SMG
+    PowerGatingGfxPipeline = (1U << 2),    //! GFX_PIPELINE
+    PowerGatingCP = (1U << 3),             //! CP
+    PowerGatingUVD = (1U << 4),
+    PowerGatingVCE = (1U << 5),
+};
+
+struct ChipInfo {
+    ChipType type;
+    UInt32 familyId;
+    bool gcn3;
+    RevisionSource revisionSource;
+    const char *vcePrefix;
+    const char *uvdPrefix;
+    UInt32 goldenGBAddrConfig;
+    UInt32 rasterConfig;    //! PA_SC_RASTER_CONFIG with every RB active
+    UInt32 powerGating;
+};
+
+struct DeviceRangeInfo {
+    UInt16 first, last;
+    ChipType chipType;
+    ChipVariant chipVariant;
+    UInt16 enumeratedRevision;
+    UInt8 cuCount;
+    UInt8 rbsPerSE;
+    const char *fallbackBranding;
+};
+
+//! Chip variant selected by the internal revision, i.e. Kabini vs Bhavani
+struct StrapsInfo {
+    ChipType chipType;
+    UInt8 revision;
+    ChipVariant chipVariant;
+    UInt16 enumeratedRevision;
+};
+
+//! Per-PCI revision overrides, `ChipVariant::Unknown` and zero CUs mean "keep the device default"
+struct RevisionRangeInfo {
+    UInt16 deviceId;
+    UInt8 first, last;
+    ChipVariant chipVariant;
+    UInt8 cuCount;
+};
+
+struct SKUInfo {
+    UInt32 key;    //! (deviceId << 8) | pciRevision
+    const char *branding;
+};
+
+#include "DeviceTable.hpp"
+
+//! The tables are generated sorted and free of overlaps, verified at build time by Scripts/GenerateDeviceTable.py.
+//! Everything below is a plain binary search.
+
+static constexpr bool deviceChipsOrdered() {
+    for (size_t i = 0; i < arrsize(deviceChips); i++) {
+        if (static_cast<size_t>(deviceChips[i].type) != i) { return false; }
+    }
+    return arrsize(deviceChips) == static_cast<size_t>(ChipType::Unknown);
+}
+static_assert(deviceChipsOrdered(), "Devices.csv chip entries must follow the ChipType order");
+
+static_assert(arrsize(deviceGoldenRegisters) == static_cast<size_t>(ChipType::Unknown),
+    "Every chip type needs a golden register entry");
+
+inline const ChipInfo &getChipInfo(ChipType type) {
+    PANIC_COND(type >= ChipType::Unknown, "DeviceDB", "Unknown chip type");
+    return deviceChips[static_cast<size_t>(type)];
+}
+
+//! Null when CAIL should keep the donor's golden settings, which is the case on every GCN 2 chip
+inline const CAILASICGoldenRegisterSettings *getGoldenRegisters(ChipType type) {
+    PANIC_COND(type >= ChipType::Unknown, "DeviceDB", "Unknown chip type");
+    return deviceGoldenRegisters[static_cast<size_t>(type)];
+}
+
+inline const DeviceRangeInfo *lookupDevice(UInt16 deviceId) {
+    size_t lo = 0, hi = arrsize(deviceRanges);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (deviceRanges[mid].last < deviceId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < arrsize(deviceRanges) && deviceRanges[lo].first <= deviceId) { return &deviceRanges[lo]; }
+    return nullptr;
+}
+
+inline const StrapsInfo *lookupStraps(ChipType chipType, UInt16 revision) {
+    for (auto &entry : deviceStraps) {
+        if (entry.chipType == chipType && entry.revision == revision) { return &entry; }
+    }
+    return nullptr;
+}
+
+inline bool chipHasStraps(ChipType chipType) {
+    for (auto &entry : deviceStraps) {
+        if (entry.chipType == chipType) { return true; }
+    }
+    return false;
+}
+
+inline const RevisionRangeInfo *lookupRevisionRange(UInt16 deviceId, UInt8 pciRevision) {
+    UInt32 key = (static_cast<UInt32>(deviceId) << 8) | pciRevision;
+    size_t lo = 0, hi = arrsize(deviceRevisionRanges);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        auto &entry = deviceRevisionRanges[mid];
+        if (((static_cast<UInt32>(entry.deviceId) << 8) | entry.last) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < arrsize(deviceRevisionRanges)) {
+        auto &entry = deviceRevisionRanges[lo];
+        if (entry.deviceId == deviceId && entry.first <= pciRevision) { return &entry; }
+    }
+    return nullptr;
+}
+
+inline const char *lookupSKUBranding(UInt16 deviceId, UInt8 pciRevision) {
+    UInt32 key = (static_cast<UInt32>(deviceId) << 8) | pciRevision;
+    size_t lo = 0, hi = arrsize(deviceSKUs);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (deviceSKUs[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < arrsize(deviceSKUs) && deviceSKUs[lo].key == key) { return deviceSKUs[lo].branding; }
+    return nullptr;
+}
+
+inline const char *getBranding(UInt16 dev, UInt16 rev) {
+    const auto *branding = lookupSKUBranding(dev, static_cast<UInt8>(rev));
+    if (branding) { return branding; }
+    const auto *device = lookupDevice(dev);
+    return device ? device->fallbackBranding : "AMD Radeon R Graphics";
+}
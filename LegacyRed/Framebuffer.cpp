@@ -4,6 +4,7 @@
 #include "Framebuffer.hpp"
 #include "LRed.hpp"
 #include "PatcherPlus.hpp"
+#include "Support.hpp"
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_util.hpp>
 
@@ -16,20 +17,52 @@ Framebuffer *Framebuffer::callback = nullptr;
 
 void Framebuffer::init() {
     callback = this;
-    this->fbPtrs[0] = nullptr;
-    this->fbPtrs[1] = nullptr;
-    this->fbPtrs[2] = nullptr;
-    this->fbPtrs[3] = nullptr;
-    this->fbPtrs[4] = nullptr;
-    this->fbPtrs[5] = nullptr;
+    this->registryLock = IOLockAlloc();
+    PANIC_COND(!this->registryLock, "Framebuffer", "Failed to allocate the registry lock");
+    this->dumpCall = thread_call_allocate(
+        [](thread_call_param_t param0, thread_call_param_t) {
+            auto *that = static_cast<Framebuffer *>(param0);
+            __atomic_store_n(&that->dumpPending, false, __ATOMIC_RELEASE);
+            that->dumpAllFramebuffers();
+            that->fbDumpDevProps();
+            Support::callback->publishLinkTrace();
+        },
+        this);
+    PANIC_COND(!this->dumpCall, "Framebuffer", "Failed to allocate the dump thread call");
     lilu.onKextLoadForce(&kextAMDFramebuffer);
 }
 
+//! Link changes and mode validation arrive in bursts, one dump at the end of the burst is plenty.
+//! The window isn't pushed back by later events, so a steady stream still gets dumped.
+void Framebuffer::scheduleDump() {
+    if (__atomic_exchange_n(&this->dumpPending, true, __ATOMIC_ACQ_REL)) { return; }
+    UInt64 deadline = 0;
+    clock_interval_to_deadline(DumpDebounceMs, kMillisecondScale, &deadline);
+    thread_call_enter_delayed(this->dumpCall, deadline);
+}
+
+//! Republishing makes IORegistry notify every observer, skip it when nothing changed
+void Framebuffer::publishIfChanged(const char *key, OSDictionary *&last, OSDictionary *dict) {
+    if (last && last->isEqualTo(dict)) { return; }
+    OSSafeReleaseNULL(last);
+    dict->retain();
+    last = dict;
+    LRed::callback->iGPU->setProperty(key, dict);
+}
+
 bool Framebuffer::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
     if (kextAMDFramebuffer.loadIndex == index) {
-        // if (PE_parse_boot_argn("AMDBitsPerComponent", &this->bitsPerComponent, sizeof(this->bitsPerComponent))) {
-        // DBGLOG("Framebuffer", "Bits Per Component: %d", this->bitsPerComponent);
-        //}
+        //! `lredbpc` caps every framebuffer, `lredbpc<n>` caps framebuffer n only
+        if (parseBitsPerComponent("lredbpc", this->bitsPerComponent)) {
+            DBGLOG("Framebuffer", "Bits Per Component: %d", this->bitsPerComponent);
+        }
+        char name[16];
+        for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+            snprintf(name, arrsize(name), "lredbpc%d", i);
+            if (parseBitsPerComponent(name, this->fbBitsPerComponent[i])) {
+                DBGLOG("Framebuffer", "Framebuffer %d Bits Per Component: %d", i, this->fbBitsPerComponent[i]);
+            }
+        }
         SolveRequestPlus solveRequests[] = {
             {"__ZN14AMDFramebuffer32getDevicePropertiesForUserClientEP12OSDictionary", this->orgGetDevPropsForUC},
             {"__ZN14AMDFramebuffer26getPropertiesForUserClientEP12OSDictionary", this->orgGetPropsForUC},
@@ -43,100 +76,268 @@ bool Framebuffer::processKext(KernelPatcher &patcher, size_t index, mach_vm_addr
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "Framebuffer",
             "Failed to route populateDisplayModeInformation!");
+        //! Only needed for the registry and statistics, carry on without them
+        RouteRequestPlus optionalRequests[] {
+            {"__ZN14AMDFramebuffer4stopEP9IOService", wrapStop, this->orgStop},
+            {"__ZN14AMDFramebuffer14setDisplayModeEii", wrapSetDisplayMode, this->orgSetDisplayMode},
+        };
+        SYSLOG_COND(!RouteRequestPlus::routeAll(patcher, index, optionalRequests, address, size), "Framebuffer",
+            "Failed to route stop/setDisplayMode, slots of stopped framebuffers won't be reused");
         return true;
     }
     return false;
 }
 
+//! Calling into AMDFramebuffer with `registryLock` held would invert the order against its own hooks, which take it
+UInt32 Framebuffer::copyFramebuffers(OSObject *(&fbs)[MAX_FRAMEBUFFER_COUNT]) {
+    UInt32 count = 0;
+    IOLockLock(this->registryLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        fbs[i] = static_cast<OSObject *>(this->fbPtrs[i]);
+        if (fbs[i]) {
+            fbs[i]->retain();
+            count++;
+        }
+    }
+    IOLockUnlock(this->registryLock);
+    return count;
+}
+
 IOReturn Framebuffer::dumpAllFramebuffers() {
-    OSDictionary *upperDict = OSDictionary::withCapacity(6);
-    if (upperDict == nullptr) {
-        DBGLOG("Framebuffer", "Failed to create dictionary");
-        return kIOReturnNoMemory;
-    } else if (fbPtrs[0] == nullptr) {
-        OSSafeReleaseNULL(upperDict);
-        DBGLOG("Framebuffer", "Cannot dump at this time, FB 0 pointer is null.");
+    OSObject *fbs[MAX_FRAMEBUFFER_COUNT];
+    if (!this->copyFramebuffers(fbs)) {
+        DBGLOG("Framebuffer", "Cannot dump at this time, no framebuffer has started.");
         return kIOReturnNoDevice;
     }
-    for (int i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
-        if (callback->fbPtrs[i] == nullptr) {
-            break;
-        } else {
-            OSDictionary *dict = OSDictionary::withCapacity(1);
-            if (dict == nullptr) {
-                DBGLOG("Framebuffer", "Failed to create dictionary");
-                OSSafeReleaseNULL(upperDict);
-                return kIOReturnNoMemory;
-            }
-            callback->orgGetPropsForUC(callback->fbPtrs[i], dict);
+    OSDictionary *upperDict = OSDictionary::withCapacity(6);
+    IOReturn ret = kIOReturnSuccess;
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (fbs[i] == nullptr) { continue; }
+        OSDictionary *dict = upperDict ? OSDictionary::withCapacity(2) : nullptr;
+        if (dict) {
+            this->orgGetPropsForUC(fbs[i], dict);
             char name[128];
             snprintf(name, 128, "Framebuffer %d", i);
             upperDict->setObject(name, dict);
-            OSSafeReleaseNULL(dict);
+        } else {
+            ret = kIOReturnNoMemory;
         }
+        OSSafeReleaseNULL(dict);
+        OSSafeReleaseNULL(fbs[i]);
+    }
+    if (ret == kIOReturnSuccess) {
+        this->publishIfChanged("iGPU Framebuffer Config", this->lastFBConfig, upperDict);
+    } else {
+        DBGLOG("Framebuffer", "Failed to create dictionary");
     }
-    LRed::callback->iGPU->setProperty("iGPU Framebuffer Config", upperDict);
     OSSafeReleaseNULL(upperDict);
-    return kIOReturnSuccess;
+    this->publishStats();
+    return ret;
+}
+
+//! The counters change on every event, so they live under their own key and aren't compared against the last dump
+void Framebuffer::publishStats() {
+    auto *dict = OSDictionary::withCapacity(MAX_FRAMEBUFFER_COUNT + 3);
+    if (!dict) { return; }
+    char name[128];
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (__atomic_load_n(&this->fbPtrs[i], __ATOMIC_RELAXED) == nullptr) { continue; }
+        auto *stats = this->copyStats(i);
+        if (!stats) { continue; }
+        snprintf(name, 128, "Framebuffer %d", i);
+        dict->setObject(name, stats);
+        OSSafeReleaseNULL(stats);
+    }
+    const struct {
+        const char *name;
+        UInt32 value;
+    } numbers[] = {
+        {"Validations", __atomic_load_n(&this->validations, __ATOMIC_RELAXED)},
+        {"CachedValidations", __atomic_load_n(&this->cachedValidations, __ATOMIC_RELAXED)},
+        {"LinkChanges", __atomic_load_n(&this->linkChanges, __ATOMIC_RELAXED)},
+    };
+    for (auto &number : numbers) {
+        auto *num = OSNumber::withNumber(number.value, 32);
+        if (num) { dict->setObject(number.name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    LRed::callback->iGPU->setProperty("iGPU Framebuffer Stats", dict);
+    OSSafeReleaseNULL(dict);
 }
 
 IOReturn Framebuffer::fbDumpDevProps() {
-    if (this->fbPtrs[0] == nullptr) {
-        DBGLOG("Framebuffer", "Cannot dump at this time, FB 0 pointer is null.");
+    OSObject *fbs[MAX_FRAMEBUFFER_COUNT];
+    if (!this->copyFramebuffers(fbs)) {
+        DBGLOG("Framebuffer", "Cannot dump at this time, no framebuffer has started.");
         return kIOReturnNoDevice;
     }
-
     OSDictionary *dict = OSDictionary::withCapacity(1);
+
+    //! The device properties are shared, any framebuffer will do
+    bool dumped = false;
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (fbs[i] == nullptr) { continue; }
+        //! funnily enough theres one where we can dump the FB itself
+        if (dict && !dumped) {
+            this->orgGetDevPropsForUC(fbs[i], dict);    //! attrocity #1
+            dumped = true;
+        }
+        OSSafeReleaseNULL(fbs[i]);
+    }
     if (dict == nullptr) {
         DBGLOG("Framebuffer", "Failed to create dictionary");
         return kIOReturnNoMemory;
     }
 
-    //! funnily enough theres one where we can dump the FB itself
-    callback->orgGetDevPropsForUC(callback->fbPtrs[0], dict);    //! attrocity #1
-
-    LRed::callback->iGPU->setProperty("iGPU Device Config", dict);
+    this->publishIfChanged("iGPU Device Config", this->lastDeviceConfig, dict);
     OSSafeReleaseNULL(dict);
 
     return kIOReturnSuccess;
 }
 
+SInt32 Framebuffer::claimSlot(void *that) {
+    SInt32 slot = -1;
+    IOLockLock(this->registryLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (this->fbPtrs[i] == that) {
+            slot = static_cast<SInt32>(i);
+            break;
+        }
+        if (slot < 0 && this->fbPtrs[i] == nullptr) { slot = static_cast<SInt32>(i); }
+    }
+    if (slot >= 0 && this->fbPtrs[slot] != that) {
+        this->fbPtrs[slot] = that;
+        this->stats[slot] = {};
+    }
+    IOLockUnlock(this->registryLock);
+    return slot;
+}
+
+void Framebuffer::releaseSlot(void *that) {
+    IOLockLock(this->registryLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (this->fbPtrs[i] == that) { this->fbPtrs[i] = nullptr; }
+    }
+    IOLockUnlock(this->registryLock);
+}
+
+SInt32 Framebuffer::findSlot(void *that) {
+    SInt32 slot = -1;
+    IOLockLock(this->registryLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        if (this->fbPtrs[i] == that) {
+            slot = static_cast<SInt32>(i);
+            break;
+        }
+    }
+    IOLockUnlock(this->registryLock);
+    return slot;
+}
+
+void Framebuffer::countValidation(bool cached) {
+    __atomic_fetch_add(cached ? &this->cachedValidations : &this->validations, 1, __ATOMIC_RELAXED);
+}
+
+void Framebuffer::countLinkChange() { __atomic_fetch_add(&this->linkChanges, 1, __ATOMIC_RELAXED); }
+
+OSDictionary *Framebuffer::copyStats(UInt32 index) {
+    auto *dict = OSDictionary::withCapacity(4);
+    if (!dict) { return nullptr; }
+    auto &entry = this->stats[index];
+    UInt32 modeInfoCalls = __atomic_load_n(&entry.modeInfoCalls, __ATOMIC_RELAXED);
+    UInt64 modeInfoTotalNs = __atomic_load_n(&entry.modeInfoTotalNs, __ATOMIC_RELAXED);
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"ModeSets", __atomic_load_n(&entry.modeSets, __ATOMIC_RELAXED)},
+        {"ModeInfoCalls", modeInfoCalls},
+        {"ModeInfoAvgUs", modeInfoCalls ? modeInfoTotalNs / modeInfoCalls / 1000 : 0},
+        {"ModeInfoMaxUs", __atomic_load_n(&entry.modeInfoMaxNs, __ATOMIC_RELAXED) / 1000},
+    };
+    for (auto &number : numbers) {
+        auto *num = OSNumber::withNumber(number.value, 64);
+        if (num) { dict->setObject(number.name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    return dict;
+}
+
 IOReturn Framebuffer::wrapPopulateDisplayModeInfo(void *that, void *detailedTiming, void *param2, void *param3,
     void *param4, void *modeInfo) {
     DBGLOG("Framebuffer",
         "populateDisplayModeInfo: that %p, detailedTming %p, param2 %p, param3 %p, param5 %p, modeInfo %p", that,
         detailedTiming, param2, param3, param4, modeInfo);
+    UInt64 start = mach_absolute_time();
     IOReturn ret = FunctionCast(wrapPopulateDisplayModeInfo, callback->orgPopulateDisplayModeInfo)(that, detailedTiming,
         param2, param3, param4, modeInfo);
-    //! BROKEN
-    /*
-    switch (callback->bitsPerComponent) {
-            case 0:
-                    break;
-            case 5:
-                    getMember<UInt32>(modeInfo, 0xC) = 0;
-                    break;
-            case 8:
-                    getMember<UInt32>(modeInfo, 0xC) = 1;
-                    break;
-            case 10:
-                    getMember<UInt32>(modeInfo, 0xC) = 2;
-                    break;
-            default:
-                    PANIC("Framebuffer", "Unsupported bits per component value!");
-    }
-    */
+    UInt64 ns = 0;
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+
+    //! Only ever lower `maxDepthIndex`, raising it advertises depths DAL can't scan out for this mode,
+    //! which is what broke the old override.
+    UInt32 bpc = callback->bitsPerComponent;
+    SInt32 slot = callback->findSlot(that);
+    if (slot >= 0) {
+        if (callback->fbBitsPerComponent[slot]) { bpc = callback->fbBitsPerComponent[slot]; }
+        auto &entry = callback->stats[slot];
+        __atomic_fetch_add(&entry.modeInfoCalls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&entry.modeInfoTotalNs, ns, __ATOMIC_RELAXED);
+        //! Racing updates can lose a maximum, which is fine for a statistic
+        if (ns > __atomic_load_n(&entry.modeInfoMaxNs, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&entry.modeInfoMaxNs, ns, __ATOMIC_RELAXED);
+        }
+    }
+    if (ret == kIOReturnSuccess && bpc) {
+        auto &maxDepthIndex = getMember<UInt32>(modeInfo, 0xC);
+        UInt32 depthIndex = depthIndexForBitsPerComponent(bpc);
+        if (depthIndex < maxDepthIndex) { maxDepthIndex = depthIndex; }
+    }
     DBGLOG("FB", "populateDisplayModeInfo: ret: 0x%x, maxDepthIndex: 0x%x (%d)", ret,
         getMember<UInt32>(modeInfo, 0xC), getMember<UInt32>(modeInfo, 0xC));
     return ret;
 }
 
-bool Framebuffer::wrapStart(void *that, void *provider) {
-    DBGLOG("FB", "<%p>::start(%p)", that, provider);
-    for (int i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
-        if (callback->fbPtrs[i] == nullptr) {
-            callback->fbPtrs[i] = that;
-        }
+//! AMDFramebuffer's depth table is 16bpp, 32bpp, then 30bpp
+UInt32 Framebuffer::depthIndexForBitsPerComponent(UInt32 bpc) {
+    switch (bpc) {
+        case 5:
+            return 0;
+        case 8:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+bool Framebuffer::parseBitsPerComponent(const char *name, UInt32 &bpc) {
+    UInt32 value = 0;
+    if (!PE_parse_boot_argn(name, &value, sizeof(value))) { return false; }
+    if (value != 5 && value != 8 && value != 10) {
+        SYSLOG("Framebuffer", "Ignoring %s=%d, only 5, 8 and 10 bits per component are supported", name, value);
+        return false;
     }
-    return FunctionCast(wrapStart, callback->orgStart)(that, provider);
+    bpc = value;
+    return true;
+}
+
+bool Framebuffer::wrapStart(void *that, void *provider) {
+    SInt32 slot = callback->claimSlot(that);
+    DBGLOG("FB", "<%p>::start(%p) in slot %d", that, provider, slot);
+    SYSLOG_COND(slot < 0, "FB", "More than %d framebuffers, %p won't be tracked", MAX_FRAMEBUFFER_COUNT, that);
+    auto ret = FunctionCast(wrapStart, callback->orgStart)(that, provider);
+    if (!ret) { callback->releaseSlot(that); }
+    return ret;
+}
+
+void Framebuffer::wrapStop(void *that, void *provider) {
+    DBGLOG("FB", "<%p>::stop(%p)", that, provider);
+    callback->releaseSlot(that);
+    FunctionCast(wrapStop, callback->orgStop)(that, provider);
+}
+
+IOReturn Framebuffer::wrapSetDisplayMode(void *that, SInt32 displayMode, SInt32 depth) {
+    SInt32 slot = callback->findSlot(that);
+    if (slot >= 0) { __atomic_fetch_add(&callback->stats[slot].modeSets, 1, __ATOMIC_RELAXED); }
+    return FunctionCast(wrapSetDisplayMode, callback->orgSetDisplayMode)(that, displayMode, depth);
 }
@@ -4,11 +4,21 @@
 #pragma once
 #include "AMDCommon.hpp"
 #include <Headers/kern_patcher.hpp>
+#include <IOKit/IOLocks.h>
+#include <kern/thread_call.h>
 
 using t_getPropsForUserClient = void (*)(void *fb, OSDictionary *dict);
 
 constexpr UInt32 MAX_FRAMEBUFFER_COUNT = 6;
 
+//! Updated with atomics from whichever thread the event comes in on
+struct FramebufferStats {
+    UInt32 modeSets;
+    UInt32 modeInfoCalls;
+    UInt64 modeInfoTotalNs;
+    UInt64 modeInfoMaxNs;
+};
+
 class Framebuffer {
     public:
     static Framebuffer *callback;
@@ -16,17 +26,49 @@ class Framebuffer {
     bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
     IOReturn fbDumpDevProps();
     IOReturn dumpAllFramebuffers();
+    void scheduleDump();
+    //! AGDC identifies framebuffers by IOFBDependentIndex, not by our slots, so these aren't per framebuffer
+    void countValidation(bool cached);
+    void countLinkChange();
 
     private:
     mach_vm_address_t orgPopulateDisplayModeInfo {0};
     mach_vm_address_t orgStart {0};
+    mach_vm_address_t orgStop {0};
+    mach_vm_address_t orgSetDisplayMode {0};
     t_getPropsForUserClient orgGetDevPropsForUC {0};
     t_getPropsForUserClient orgGetPropsForUC {0};
 
     static IOReturn wrapPopulateDisplayModeInfo(void *that, void *detailedTiming, void *param2, void *param3,
         void *param4, void *modeInfo);
     static bool wrapStart(void *that, void *provider);
+    static void wrapStop(void *that, void *provider);
+    static IOReturn wrapSetDisplayMode(void *that, SInt32 displayMode, SInt32 depth);
+    static UInt32 depthIndexForBitsPerComponent(UInt32 bpc);
+    static bool parseBitsPerComponent(const char *name, UInt32 &bpc);
 
     UInt32 bitsPerComponent {0};
-    void *fbPtrs[6];
+    UInt32 fbBitsPerComponent[MAX_FRAMEBUFFER_COUNT] {};
+
+    //! Guards `fbPtrs`, slots are claimed on start and released on stop so indices stay stable
+    IOLock *registryLock {nullptr};
+    void *fbPtrs[MAX_FRAMEBUFFER_COUNT] {};
+    FramebufferStats stats[MAX_FRAMEBUFFER_COUNT] {};
+    UInt32 validations {0};
+    UInt32 cachedValidations {0};
+    UInt32 linkChanges {0};
+    SInt32 claimSlot(void *that);
+    void releaseSlot(void *that);
+    SInt32 findSlot(void *that);
+    //! Retains every started framebuffer so it can be called into after the lock is dropped
+    UInt32 copyFramebuffers(OSObject *(&fbs)[MAX_FRAMEBUFFER_COUNT]);
+    OSDictionary *copyStats(UInt32 index);
+    void publishStats();
+
+    static constexpr UInt32 DumpDebounceMs = 250;
+    thread_call_t dumpCall {nullptr};
+    bool dumpPending {false};
+    OSDictionary *lastFBConfig {nullptr};
+    OSDictionary *lastDeviceConfig {nullptr};
+    void publishIfChanged(const char *key, OSDictionary *&last, OSDictionary *dict);
 };
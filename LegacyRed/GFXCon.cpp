@@ -30,6 +30,9 @@ GFXCon *GFXCon::callback = nullptr;
 
 void GFXCon::init() {
     callback = this;
+    this->ihStatsCall = thread_call_allocate(
+        [](thread_call_param_t param0, thread_call_param_t) { static_cast<GFXCon *>(param0)->IHPublishStats(); }, this);
+    PANIC_COND(!this->ihStatsCall, "GFXCon", "Failed to allocate the IH stats thread call");
     lilu.onKextLoadForce(&kextAMD8KController);
     lilu.onKextLoadForce(&kextAMD9KController);
     lilu.onKextLoadForce(&kextAMD95KController);
@@ -50,7 +53,6 @@ bool GFXCon::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         LRed::callback->setRMMIOIfNecessary();
 
         SolveRequestPlus solveRequests[] = {
-            {"__ZN18VIInterruptManager16setRBReadPointerEj", this->IHSetRBReadPointer},
             {"__ZN18VIInterruptManager22getWPTRWriteBackOffsetEv", this->IHGetWPTRWriteBackOffset},
             {"__ZN18VIInterruptManager24isUsingVRAMForRingBufferEv", this->IHIsUsingVRAMForRingBuffer},
             {"__ZN18VIInterruptManager31getActiveRingBufferSizeRegValueEv", this->IHGetActiveRingBufferSizeRegValue},
@@ -58,10 +60,32 @@ bool GFXCon::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         PANIC_COND(!SolveRequestPlus::solveAll(patcher, index, solveRequests, address, size), "GFXCon",
             "Failed to solve symbols for IH");
 
+        //! With MSI, the IH reads this page after each interrupt it raises.
+        //! It must be below 40 bits for INTERRUPT_CNTL2.
+        if (Support::callback->msiIndex > 0) {
+            this->ihDummyPage = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task,
+                kIODirectionInOut | kIOMemoryPhysicallyContiguous, PAGE_SIZE, 0xFFFFFFFFFFULL & ~PAGE_MASK);
+            PANIC_COND(!this->ihDummyPage || this->ihDummyPage->prepare() != kIOReturnSuccess, "GFXCon",
+                "Failed to allocate the IH dummy page");
+            bzero(this->ihDummyPage->getBytesNoCopy(), PAGE_SIZE);
+            this->ihDummyPageAddr = this->ihDummyPage->getPhysicalAddress();
+        }
+
+        UInt32 profile = 0;
+        if (PE_parse_boot_argn("lredihmod", &profile, sizeof(profile))) {
+            if (profile < arrsize(ihModerationProfiles)) {
+                this->ihModeration = &ihModerationProfiles[profile];
+            } else {
+                SYSLOG("GFXCon", "Invalid IH moderation profile %d", profile);
+            }
+        }
+        DBGLOG("GFXCon", "IH moderation profile: %s", this->ihModeration->name);
+
         RouteRequestPlus requests[] = {
             {"__ZNK18VISharedController11getFamilyIdEv", wrapGetFamilyId, this->orgGetFamilyId},
             {"__ZN13ASIC_INFO__VI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo},
             {"__ZN18VIInterruptManager18setHardwareEnabledEb", IHSetHardwareEnabled},
+            {"__ZN18VIInterruptManager16setRBReadPointerEj", wrapIHSetRBReadPointer, this->orgIHSetRBReadPointer},
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "GFXCon",
             "Failed to route symbols");
@@ -92,21 +116,6 @@ IOReturn GFXCon::wrapPopulateDeviceInfo(void *that) {
 
 //-------- Carrizo IH fixes !!! WIP DO NOT USE YET !!! --------//
 
-enum InterruptManagerFields {
-    Unk1 = 0x32,
-    Flags = 0x38,
-    Unk2 = 0x3C,
-    GPUAddress = 0x48,
-    Unk3 = 0x50,
-};
-
-enum InterruptManagerFlags {
-    UseSRRB = 0x1,
-    MSIEnabled = 0x2,
-    DontUsePulseBasedInterrupts = 0x8,
-    IHEnableClockGating = 0x10,    //! unused in VIIntMgr
-};
-
 //! description:
 //! Properly power-up the IH, Tonga's OSS 3.0.0 uses a new bit in the RB_CNTL to fully
 //! get the IH ready for usage, this bit is not present on the OSS 3.0.1 IH and thus
@@ -115,7 +124,8 @@ void GFXCon::IHSetHardwareEnabled(void *ihmgr, bool enabled) {
     DBGLOG("GFXCon", "CZ IH @ setHardwareEnabled: enabled = 0x%x", enabled);
     if (enabled) {
         Support::callback->IHAcknowledgeAllOutStandingInterrupts(ihmgr);
-        callback->IHSetRBReadPointer(ihmgr, 0);
+        callback->ihLastRPTR = 0;
+        FunctionCast(wrapIHSetRBReadPointer, callback->orgIHSetRBReadPointer)(ihmgr, 0);
         LRed::callback->writeReg32(mmIH_RB_WPTR, 0);    //! what
 
         IODelay(10);    //! give it a lil time to catch up
@@ -127,6 +137,47 @@ void GFXCon::IHSetHardwareEnabled(void *ihmgr, bool enabled) {
             DBGLOG("GFXCon", "CZ IH @ setHardwareEnabled (true): what.");
         }
 
+        //! RB_SIZE is log2 of the ring size in dwords, 5 bits wide
+        UInt32 rbSize = callback->IHGetActiveRingBufferSizeRegValue(ihmgr);
+        callback->ihRingMask = rbSize < 0x1F ? (4U << rbSize) - 1 : 0;
+
+        //! Have the IH write WPTR back to memory so the consumer doesn't poll IH_RB_WPTR over MMIO,
+        //! and flag overflows instead of silently overwriting unread entries. See amdgpu's cz_ih_irq_init.
+        UInt64 wptrAddr = getMember<UInt64>(ihmgr, InterruptManagerFields::GPUAddress) +
+                          callback->IHGetWPTRWriteBackOffset(ihmgr);
+        LRed::callback->writeReg32(mmIH_RB_WPTR_ADDR_LO, static_cast<UInt32>(wptrAddr));
+        LRed::callback->writeReg32(mmIH_RB_WPTR_ADDR_HI,
+            static_cast<UInt32>(wptrAddr >> 32) & IH_RB_WPTR_ADDR_HI__ADDR_MASK);
+        tmp |= IH_RB_CNTL__WPTR_WRITEBACK_ENABLE | IH_RB_CNTL__WPTR_OVERFLOW_ENABLE | IH_RB_CNTL__WPTR_OVERFLOW_CLEAR;
+
+        //! With MSI the IH has to re-fire when RPTR is written and entries are still pending,
+        //! the dummy read is then dropped by the hardware as long as it isn't overridden. See amdgpu's cz_ih_irq_init.
+        UInt32 intCntl = LRed::callback->readReg32(mmINTERRUPT_CNTL) & ~INTERRUPT_CNTL__IH_DUMMY_RD_OVERRIDE_MASK;
+        if (callback->IHIsUsingVRAMForRingBuffer(ihmgr)) {
+            intCntl |= INTERRUPT_CNTL__IH_REQ_NONSNOOP_EN_MASK;
+        } else {
+            intCntl &= ~INTERRUPT_CNTL__IH_REQ_NONSNOOP_EN_MASK;
+        }
+        if (callback->ihDummyPage) {
+            LRed::callback->writeReg32(mmINTERRUPT_CNTL2, static_cast<UInt32>(callback->ihDummyPageAddr >> 8));
+        }
+        LRed::callback->writeReg32(mmINTERRUPT_CNTL, intCntl);
+        if (getMember<UInt32>(ihmgr, InterruptManagerFields::Flags) & InterruptManagerFlags::MSIEnabled) {
+            tmp2 |= IH_CNTL__RPTR_REARM;
+        } else {
+            tmp2 &= ~IH_CNTL__RPTR_REARM;
+        }
+
+        auto *moderation = callback->ihModeration;
+        if (moderation != &ihModerationProfiles[0]) {
+            tmp &= ~IH_RB_CNTL__WPTR_WRITEBACK_TIMER_MASK;
+            tmp |= (moderation->writebackTimer << IH_RB_CNTL__WPTR_WRITEBACK_TIMER__SHIFT) &
+                   IH_RB_CNTL__WPTR_WRITEBACK_TIMER_MASK;
+            tmp2 &= ~(IH_CNTL__MC_WRREQ_CREDIT_MASK | IH_CNTL__MC_WR_CLEAN_CNT_MASK);
+            tmp2 |= ((moderation->wrreqCredit << IH_CNTL__MC_WRREQ_CREDIT__SHIFT) & IH_CNTL__MC_WRREQ_CREDIT_MASK) |
+                    ((moderation->wrCleanCnt << IH_CNTL__MC_WR_CLEAN_CNT__SHIFT) & IH_CNTL__MC_WR_CLEAN_CNT_MASK);
+        }
+
         tmp |= IH_RB_CNTL__RB_ENABLE;
         tmp2 |= IH_CNTL__ENABLE_INTR;
 
@@ -145,9 +196,70 @@ void GFXCon::IHSetHardwareEnabled(void *ihmgr, bool enabled) {
 
         IODelay(10);    //! give it a lil time to catch up
 
-        callback->IHSetRBReadPointer(ihmgr, 0);
+        callback->ihLastRPTR = 0;
+        FunctionCast(wrapIHSetRBReadPointer, callback->orgIHSetRBReadPointer)(ihmgr, 0);
         LRed::callback->writeReg32(mmIH_RB_WPTR, 0);    //! what
         Support::callback->IHAcknowledgeAllOutStandingInterrupts(ihmgr);
+        callback->IHScheduleStats();
     }
     getMember<char>(ihmgr, InterruptManagerFields::Unk1) = 0;    //! what
 }
+
+//! The drain loop lives in the controller, which updates RPTR once per IV entry.
+//! Skip the MMIO write when nothing moved, and only look for an overflow once every quarter of the ring,
+//! the earliest the IH can have wrapped around unread entries since the last look.
+void GFXCon::wrapIHSetRBReadPointer(void *that, UInt32 rptr) {
+    auto &stats = callback->ihStats;
+    auto mask = callback->ihRingMask;
+    __atomic_fetch_add(&stats.rptrUpdates, 1, __ATOMIC_RELAXED);
+    if (rptr == callback->ihLastRPTR) {
+        __atomic_fetch_add(&stats.rptrWritesElided, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    UInt32 quarter = (mask + 1) / 4;
+    bool crossedQuarter = quarter && (rptr / quarter) != (callback->ihLastRPTR / quarter);
+    __atomic_fetch_add(&stats.entries, ((rptr - callback->ihLastRPTR) & mask) / IH_IV_ENTRY_SIZE, __ATOMIC_RELAXED);
+    callback->ihLastRPTR = rptr;
+    FunctionCast(wrapIHSetRBReadPointer, callback->orgIHSetRBReadPointer)(that, rptr);
+    if (crossedQuarter) { callback->IHCheckOverflow(); }
+}
+
+//! The interrupt manager keeps its own copy of RPTR, which we can't reach, so RPTR is left to it.
+//! Only clear the overflow flag so the next one is seen, and count it.
+void GFXCon::IHCheckOverflow() {
+    UInt32 wptr = LRed::callback->readReg32(mmIH_RB_WPTR);
+    if (LIKELY(!(wptr & IH_RB_WPTR__RB_OVERFLOW))) { return; }
+    __atomic_fetch_add(&this->ihStats.overflows, 1, __ATOMIC_RELAXED);
+    SYSLOG("GFXCon", "IH ring buffer overflow (WPTR: 0x%X, RPTR: 0x%X)", wptr & IH_RB_WPTR__OFFSET_MASK,
+        this->ihLastRPTR);
+    LRed::callback->writeReg32(mmIH_RB_CNTL,
+        LRed::callback->readReg32(mmIH_RB_CNTL) | IH_RB_CNTL__WPTR_OVERFLOW_CLEAR);
+    this->IHScheduleStats();
+}
+
+//! Called from the IH drain path, which mustn't allocate or touch the IORegistry
+void GFXCon::IHScheduleStats() { thread_call_enter(this->ihStatsCall); }
+
+void GFXCon::IHPublishStats() {
+    auto *dict = OSDictionary::withCapacity(5);
+    if (!dict) { return; }
+    auto *profile = OSString::withCString(this->ihModeration->name);
+    if (profile) { dict->setObject("ModerationProfile", profile); }
+    OSSafeReleaseNULL(profile);
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"RPTRUpdates", __atomic_load_n(&this->ihStats.rptrUpdates, __ATOMIC_RELAXED)},
+        {"RPTRWritesElided", __atomic_load_n(&this->ihStats.rptrWritesElided, __ATOMIC_RELAXED)},
+        {"Entries", __atomic_load_n(&this->ihStats.entries, __ATOMIC_RELAXED)},
+        {"Overflows", __atomic_load_n(&this->ihStats.overflows, __ATOMIC_RELAXED)},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (num) { dict->setObject(entry.name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    LRed::callback->iGPU->setProperty("IH Stats", dict);
+    OSSafeReleaseNULL(dict);
+}
@@ -5,12 +5,51 @@
 #include "AMDCommon.hpp"
 #include "PatcherPlus.hpp"
 #include <Headers/kern_util.hpp>
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include <kern/thread_call.h>
 
-using t_SetRBReadPointer = void (*)(void *that, UInt32 addr);
 using t_GetActiveRingBufferSizeRegValue = UInt32 (*)(void *that);
 using t_GetWPTRWriteBackOffset = long (*)(void *that);
 using t_IsUsingVRAMForRingBuffer = UInt32 (*)(void *that);
 
+enum InterruptManagerFields {
+    Unk1 = 0x32,
+    Flags = 0x38,
+    Unk2 = 0x3C,
+    GPUAddress = 0x48,
+    Unk3 = 0x50,
+};
+
+enum InterruptManagerFlags {
+    UseSRRB = 0x1,
+    MSIEnabled = 0x2,
+    DontUsePulseBasedInterrupts = 0x8,
+    IHEnableClockGating = 0x10,    //! unused in VIIntMgr
+};
+
+//! How the IH batches its writes to memory, selected with `lredihmod=<index>`.
+//! Neither the credits nor the WPTR write-back timer change how often interrupts fire, only how the IV entries and
+//! the WPTR copy reach memory. The default leaves IH_CNTL and the timer as the hardware has them, like cz_ih_irq_init.
+struct IHModeration {
+    const char *name;
+    UInt32 wrreqCredit;       //! IH_CNTL.MC_WRREQ_CREDIT
+    UInt32 wrCleanCnt;        //! IH_CNTL.MC_WR_CLEAN_CNT
+    UInt32 writebackTimer;    //! IH_RB_CNTL.WPTR_WRITEBACK_TIMER, log2 of the delay in clocks
+};
+
+static const IHModeration ihModerationProfiles[] = {
+    {"Default", 0x0, 0x0, 0x0},    //! Not programmed
+    {"CIK", 0x10, 0x10, 0x0},      //! amdgpu's cik_ih_irq_init
+};
+
+//! Updated with atomics from the IH drain path, read by the publisher
+struct IHStats {
+    UInt64 rptrUpdates {0};
+    UInt64 rptrWritesElided {0};
+    UInt64 entries {0};
+    UInt64 overflows {0};
+};
+
 class GFXCon {
     public:
     static GFXCon *callback;
@@ -20,7 +59,7 @@ class GFXCon {
     private:
     mach_vm_address_t orgPopulateDeviceInfo {0};
     mach_vm_address_t orgGetFamilyId {0};
-    t_SetRBReadPointer IHSetRBReadPointer;
+    mach_vm_address_t orgIHSetRBReadPointer {0};
     t_GetWPTRWriteBackOffset IHGetWPTRWriteBackOffset;
     t_GetActiveRingBufferSizeRegValue IHGetActiveRingBufferSizeRegValue;
     t_IsUsingVRAMForRingBuffer IHIsUsingVRAMForRingBuffer;
@@ -28,5 +67,18 @@ class GFXCon {
     static IOReturn wrapPopulateDeviceInfo(void *that);
     static UInt16 wrapGetFamilyId(void);
 
+    IHStats ihStats {};
+    thread_call_t ihStatsCall {nullptr};
+    //! Target of the IH's dummy read, see amdgpu's `dummy_page`
+    IOBufferMemoryDescriptor *ihDummyPage {nullptr};
+    UInt64 ihDummyPageAddr {0};
+    const IHModeration *ihModeration {&ihModerationProfiles[0]};
+    UInt32 ihLastRPTR {0};
+    UInt32 ihRingMask {0};
+
     static void IHSetHardwareEnabled(void *that, bool enabled);
+    static void wrapIHSetRBReadPointer(void *that, UInt32 rptr);
+    void IHCheckOverflow();
+    void IHScheduleStats();
+    void IHPublishStats();
 };
@@ -3,6 +3,9 @@
 
 #include "HWLibs.hpp"
 #include "LRed.hpp"
+#include "SMU.hpp"
+#include "Telemetry.hpp"
+#include "X4000.hpp"
 #include <Headers/kern_api.hpp>
 
 static const char *pathRadeonX4000HWServices =
@@ -60,6 +63,31 @@ bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "HWLibs",
             "Failed to route symbols");
 
+        //! SMU messages from LegacyRed go through PowerPlay's own mailbox code, under one lock with PowerPlay's
+        RouteRequestPlus smumRequests[] = {
+            {"_smum_send_msg_to_smc", SMU::wrapSendMsgToSmc, SMU::callback->orgSendMsgToSmc},
+            {"_smum_send_msg_to_smc_with_parameter", SMU::wrapSendMsgToSmcWithParameter,
+                SMU::callback->orgSendMsgToSmcWithParameter},
+        };
+        SYSLOG_COND(!RouteRequestPlus::routeAll(patcher, index, smumRequests, address, size), "HWLibs",
+            "Failed to route the smum functions, SMU messages from LegacyRed are unavailable");
+        //! The performance profile goes in once PowerPlay has set up DPM, at init and on every resume
+        RouteRequestPlus dpmRequests[] = {
+            {"_phm_enable_dynamic_state_management", SMU::wrapEnableDynamicStateManagement,
+                SMU::callback->orgEnableDynamicStateManagement},
+            {"_phm_disable_dynamic_state_management", SMU::wrapDisableDynamicStateManagement,
+                SMU::callback->orgDisableDynamicStateManagement},
+        };
+        SYSLOG_COND(!RouteRequestPlus::routeAll(patcher, index, dpmRequests, address, size), "HWLibs",
+            "Failed to route the PowerPlay DPM functions, performance profiles may be unavailable");
+        //! Same for the SMC index/data pair, which telemetry reads from a timer
+        RouteRequestPlus cgsRequests[] = {
+            {"_cgs_read_ind_register", SMU::wrapCgsReadIndRegister, SMU::callback->orgCgsReadIndRegister},
+            {"_cgs_write_ind_register", SMU::wrapCgsWriteIndRegister, SMU::callback->orgCgsWriteIndRegister},
+        };
+        SYSLOG_COND(!RouteRequestPlus::routeAll(patcher, index, cgsRequests, address, size), "HWLibs",
+            "Failed to route the cgs indirect register functions, telemetry is unavailable");
+
         const LookupPatchPlus patches[] = {
             {&kextRadeonX4000HWLibs, AtiPowerPlayServicesCOriginal, AtiPowerPlayServicesCPatched, 1},
         };
@@ -78,6 +106,14 @@ bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
                 orgCapsTable->pciRevision = LRed::callback->pciRevision;
                 orgCapsTable->caps = tmp->caps;
                 *orgCapsInitTable = *tmp;
+                const auto *goldenRegisters = getGoldenRegisters(LRed::callback->chipType);
+                if (goldenRegisters && tmp->goldenCaps) {
+                    //! Keep the donor's HW constants and microcode info, only the register list is ASIC-specific
+                    this->goldenSettings = *tmp->goldenCaps;
+                    this->goldenSettings.goldenRegisterSettings =
+                        const_cast<CAILASICGoldenRegisterSettings *>(goldenRegisters);
+                    orgCapsInitTable->goldenCaps = &this->goldenSettings;
+                }
                 MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
                 break;
             }
@@ -104,8 +140,11 @@ void HWLibs::wrapAmdCailServicesConstructor(void *that, IOPCIDevice *provider) {
 }
 
 void *HWLibs::wrapCreatePowerTuneServices(void *that, void *param2) {
+    SMU::callback->invalidatePowerPlayHandles();
     auto *ret = OSObject::operator new(0x18);
     callback->orgPowerTuneConstructor(ret, that, param2);
+    SMU::callback->publishPerfProfile();
+    Telemetry::callback->start();
     return ret;
 }
 
@@ -114,4 +153,5 @@ void HWLibs::wrapBonairePerformSrbmReset(void *param1, UInt32 bit) {
     bit &= ~SRBM_SOFT_RESET__SOFT_RESET_MC_MASK;
     DBGLOG("HWLibs", "Stripping SRBM_SOFT_RESET__SOFT_RESET_MC_MASK bit");
     FunctionCast(wrapBonairePerformSrbmReset, callback->orgBonairePerformSrbmReset)(param1, bit);
+    X4000::callback->resetDoorbells();
 }
@@ -20,6 +20,7 @@ class HWLibs {
     t_XPowerTuneConstructor orgPowerTuneConstructor {nullptr};
     mach_vm_address_t orgAmdCailServicesConstructor {0};
     mach_vm_address_t orgBonairePerformSrbmReset {0};
+    CAILASICGoldenSettings goldenSettings {};
 
     static const char *forceX4000HWLibs();
 
@@ -5,18 +5,22 @@
 #include "Framebuffer.hpp"
 #include "GFXCon.hpp"
 #include "HWLibs.hpp"
-#include "Model.hpp"
+#include "SMU.hpp"
 #include "Support.hpp"
+#include "Telemetry.hpp"
 #include "X4000.hpp"
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_devinfo.hpp>
 #include <IOKit/IOCatalogue.h>
 #include <IOKit/IODeviceTreeSupport.h>
+#include <IOKit/IOUserClient.h>
+#include <sys/sysctl.h>
 
 static const char *pathAGDP = "/System/Library/Extensions/AppleGraphicsControl.kext/Contents/PlugIns/"
                               "AppleGraphicsDevicePolicy.kext/Contents/MacOS/AppleGraphicsDevicePolicy";
 static const char *pathBacklight = "/System/Library/Extensions/AppleBacklight.kext/Contents/MacOS/AppleBacklight";
 static const char *pathMCCSControl = "/System/Library/Extensions/AppleMCCSControl.kext/Contents/MacOS/AppleMCCSControl";
+static const char *pathIOPCIFamily = "/System/Library/Extensions/IOPCIFamily.kext/IOPCIFamily";
 
 static KernelPatcher::KextInfo kextAGDP {"com.apple.driver.AppleGraphicsDevicePolicy", &pathAGDP, 1, {true}, {},
     KernelPatcher::KextInfo::Unloaded};
@@ -24,6 +28,8 @@ static KernelPatcher::KextInfo kextBacklight {"com.apple.driver.AppleBacklight",
     KernelPatcher::KextInfo::Unloaded};
 static KernelPatcher::KextInfo kextMCCSControl {"com.apple.driver.AppleMCCSControl", &pathMCCSControl, 1, {true}, {},
     KernelPatcher::KextInfo::Unloaded};
+static KernelPatcher::KextInfo kextIOPCIFamily {"com.apple.iokit.IOPCIFamily", &pathIOPCIFamily, 1, {true}, {},
+    KernelPatcher::KextInfo::Unloaded};
 
 LRed *LRed::callback = nullptr;
 
@@ -31,12 +37,16 @@ static Framebuffer fb;
 static GFXCon gfxcon;
 static Support support;
 static HWLibs hwlibs;
+static SMU smu;
+static Telemetry telemetry;
 static X4000 x4000;
 
 void LRed::init() {
     SYSLOG("LRed", "Copyright © 2023 ChefKiss Inc. If you've paid for this, you've been scammed.");
     SYSLOG("LRed", "This build was compiled on %s", __TIMESTAMP__);
     callback = this;
+    this->grbmIndexLock = IOLockAlloc();
+    PANIC_COND(!this->grbmIndexLock, "LRed", "Failed to allocate the GRBM_GFX_INDEX lock");
 
     lilu.onPatcherLoadForce(
         [](void *user, KernelPatcher &patcher) { static_cast<LRed *>(user)->processPatcher(patcher); }, this);
@@ -49,6 +59,9 @@ void LRed::init() {
     lilu.onKextLoadForce(&kextAGDP);
     lilu.onKextLoadForce(&kextBacklight);
     lilu.onKextLoadForce(&kextMCCSControl);
+    lilu.onKextLoadForce(&kextIOPCIFamily);
+    smu.init();
+    telemetry.init();
     hwlibs.init();
     gfxcon.init();
     x4000.init();
@@ -56,6 +69,39 @@ void LRed::init() {
     fb.init();
 }
 
+//! Only hand the personalities which can actually match our iGPU to IOCatalogue.
+//! The IOPCIMatch strings are checked against Devices.csv at build time.
+static void addDriversFromFW(const char *name, UInt32 deviceId) {
+    auto &desc = getFWDescByName(name);
+    OSString *errStr = nullptr;
+    auto *dataNull = new char[desc.size + 1];
+    memcpy(dataNull, desc.data, desc.size);
+    dataNull[desc.size] = 0;
+    auto *dataUnserialized = OSUnserializeXML(dataNull, desc.size + 1, &errStr);
+    delete[] dataNull;
+    PANIC_COND(!dataUnserialized, "LegacyRed", "Failed to unserialize %s: %s", name,
+        errStr ? errStr->getCStringNoCopy() : "<No additional information>");
+    auto *drivers = OSDynamicCast(OSArray, dataUnserialized);
+    PANIC_COND(!drivers, "LegacyRed", "Failed to cast %s data", name);
+
+    if (deviceId) {
+        char match[16];
+        snprintf(match, arrsize(match), "0x%04X1002", deviceId);
+        for (auto i = drivers->getCount(); i > 0; i--) {
+            auto *personality = OSDynamicCast(OSDictionary, drivers->getObject(i - 1));
+            auto *pciMatch = personality ? OSDynamicCast(OSString, personality->getObject("IOPCIMatch")) : nullptr;
+            if (pciMatch && !strstr(pciMatch->getCStringNoCopy(), match)) { drivers->removeObject(i - 1); }
+        }
+    }
+
+    if (drivers->getCount()) {
+        PANIC_COND(!gIOCatalogue->addDrivers(drivers), "LegacyRed", "Failed to add drivers from %s", name);
+    } else {
+        DBGLOG("LRed", "No personality in %s matches 0x%X", name, deviceId);
+    }
+    dataUnserialized->release();
+}
+
 void LRed::processPatcher(KernelPatcher &patcher) {
     auto *devInfo = DeviceInfo::create();
     if (devInfo) {
@@ -112,56 +158,22 @@ void LRed::processPatcher(KernelPatcher &patcher) {
         SYSLOG("LRed", "Failed to create DeviceInfo");
     }
 
+    support.processPatcher(patcher);
+
     if (getKernelVersion() >= KernelVersion::Ventura && this->deviceId != 0x98E4) {
         PANIC("LRed", "GCN 2 iGPUs and Carrizo/Bristol iGPUs are unsupported on macOS Ventura and newer.");
     } else {
-        auto &legacyFBDesc = getFWDescByName("LegacyFramebuffers.xml");
-        OSString *legacyFBErrStr = nullptr;
-        auto *legacyFBDataNull = new char[legacyFBDesc.size + 1];
-        memcpy(legacyFBDataNull, legacyFBDesc.data, legacyFBDesc.size);
-        legacyFBDataNull[legacyFBDesc.size] = 0;
-        auto *legacyFBDataUnserialized = OSUnserializeXML(legacyFBDataNull, legacyFBDesc.size + 1, &legacyFBErrStr);
-        delete[] legacyFBDataNull;
-        PANIC_COND(!legacyFBDataUnserialized, "LegacyRed", "Failed to unserialize LegacyFramebuffers.xml: %s",
-            legacyFBErrStr ? legacyFBErrStr->getCStringNoCopy() : "<No additional information>");
-        auto *legacyFBDrivers = OSDynamicCast(OSArray, legacyFBDataUnserialized);
-        PANIC_COND(!legacyFBDrivers, "LegacyRed", "Failed to cast LegacyFramebuffers.xml data");
-        PANIC_COND(!gIOCatalogue->addDrivers(legacyFBDrivers), "LegacyRed", "Failed to add framebuffers");
-        legacyFBDataUnserialized->release();
+        addDriversFromFW("LegacyFramebuffers.xml", this->deviceId);
     }
 
     if ((lilu.getRunMode() & LiluAPI::RunningInstallerRecovery) || checkKernelArgument("-CKFBOnly")) { return; }
 
-    auto &desc = getFWDescByName("Drivers.xml");
-    OSString *errStr = nullptr;
-    auto *dataNull = new char[desc.size + 1];
-    memcpy(dataNull, desc.data, desc.size);
-    dataNull[desc.size] = 0;
-    auto *dataUnserialized = OSUnserializeXML(dataNull, desc.size + 1, &errStr);
-    delete[] dataNull;
-    PANIC_COND(!dataUnserialized, "LegacyRed", "Failed to unserialize Drivers.xml: %s",
-        errStr ? errStr->getCStringNoCopy() : "<No additional information>");
-    auto *drivers = OSDynamicCast(OSArray, dataUnserialized);
-    PANIC_COND(!drivers, "LegacyRed", "Failed to cast Drivers.xml data");
-    PANIC_COND(!gIOCatalogue->addDrivers(drivers), "LegacyRed", "Failed to add drivers");
-    dataUnserialized->release();
+    addDriversFromFW("Drivers.xml", this->deviceId);
 
     if (getKernelVersion() >= KernelVersion::Ventura && this->deviceId != 0x98E4) {
         PANIC("LRed", "GCN 2 iGPUs and Carrizo/Bristol iGPUs are unsupported on macOS Ventura and newer.");
     } else {
-        auto &legacyDesc = getFWDescByName("LegacyDrivers.xml");
-        OSString *legacyErrStr = nullptr;
-        auto *legacyDataNull = new char[legacyDesc.size + 1];
-        memcpy(legacyDataNull, legacyDesc.data, legacyDesc.size);
-        legacyDataNull[legacyDesc.size] = 0;
-        auto *legacyDataUnserialized = OSUnserializeXML(legacyDataNull, legacyDesc.size + 1, &legacyErrStr);
-        delete[] legacyDataNull;
-        PANIC_COND(!legacyDataUnserialized, "LegacyRed", "Failed to unserialize LegacyDrivers.xml: %s",
-            legacyErrStr ? legacyErrStr->getCStringNoCopy() : "<No additional information>");
-        auto *legacyDrivers = OSDynamicCast(OSArray, legacyDataUnserialized);
-        PANIC_COND(!legacyDrivers, "LegacyRed", "Failed to cast LegacyDrivers.xml data");
-        PANIC_COND(!gIOCatalogue->addDrivers(legacyDrivers), "LegacyRed", "Failed to add drivers");
-        legacyDataUnserialized->release();
+        addDriversFromFW("LegacyDrivers.xml", this->deviceId);
     }
 }
 
@@ -180,89 +192,52 @@ void LRed::setRMMIOIfNecessary() {
         this->vramEnd = ((this->vramStart + memSize) - 1);
 
         SYSLOG("LRed", "VRAM: Size %lluMB, Start: 0x%llx, End: 0x%llx", ((this->memSize / 1024ULL) / 1024ULL), this->vramStart, this->vramEnd);
+        this->computeGARTSize();
 
         //! Who thought it would be a good idea to use this many Device IDs and Revisions?
-        switch (this->deviceId) {
-            case 0x1309 ... 0x131D:
-                this->familyId = AMDGPU_FAMILY_KV;
-                if (this->deviceId == 0x1312 || this->deviceId == 0x1316 || this->deviceId == 0x1317) {
-                    this->chipType = ChipType::Spooky;
-                    this->chipVariant = ChipVariant::Kaveri;
-                    this->enumeratedRevision = 0x41;
-                    DBGLOG("LRed", "Chip type Spooky, Kaveri variant");
-                    break;
-                }
-                this->chipType = ChipType::Spectre;
-                this->chipVariant = ChipVariant::Kaveri;
-                this->enumeratedRevision = 0x1;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                DBGLOG("LRed", "Chip type Spectre, Kaveri variant");
+        //! All of it lives in Devices.csv now.
+        const auto *device = lookupDevice(this->deviceId);
+        PANIC_COND(!device, "LRed", "Unknown device ID 0x%X", this->deviceId);
+        const auto &chip = getChipInfo(device->chipType);
+        this->chipType = device->chipType;
+        this->chipVariant = device->chipVariant;
+        this->enumeratedRevision = device->enumeratedRevision;
+        this->cuCount = device->cuCount;
+        this->rbsPerSE = device->rbsPerSE;
+        this->familyId = chip.familyId;
+        this->gcn3 = chip.gcn3;
+        this->stoney = this->chipType == ChipType::Stoney;
+
+        switch (chip.revisionSource) {
+            case RevisionSource::Straps:
+                this->revision = (this->readReg32(mmCC_DRM_ID_STRAPS) & CC_DRM_ID_STRAPS__ATI_REV_ID_MASK) >>
+                                 CC_DRM_ID_STRAPS__ATI_REV_ID__SHIFT;
                 break;
-            case 0x9830 ... 0x983D:
-                this->familyId = AMDGPU_FAMILY_KV;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                this->chipType = ChipType::Kalindi;
-                switch (this->revision) {
-                    case 0x00:
-                        this->chipVariant = ChipVariant::Kabini;
-                        this->enumeratedRevision = 0x81;
-                        DBGLOG("LRed", "Chip type Kalindi, Kabini variant");
-                        break;
-                    case 0x01:
-                        this->chipVariant = ChipVariant::Kabini;
-                        this->enumeratedRevision = 0x82;
-                        DBGLOG("LRed", "Chip type Kalindi, Kabini variant");
-                        break;
-                    case 0x02:
-                        this->chipVariant = ChipVariant::Bhavani;
-                        this->enumeratedRevision = 0x85;
-                        DBGLOG("LRed", "Chip type Kalindi, Bhavani variant");
-                        break;
-                    default:
-                        PANIC("LRed", "Unknown Kalindi revision ID");
-                }
-                break;
-            case 0x9850 ... 0x9856:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->familyId = AMDGPU_FAMILY_KV;
-                this->enumeratedRevision = 0xA1;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                DBGLOG("LRed", "Chip type Godavari, Mullins variant");
-                break;
-            case 0x9874:
-                this->familyId = AMDGPU_FAMILY_CZ;
-                this->chipType = ChipType::Carrizo;
-                this->gcn3 = true;
-                this->enumeratedRevision = 0x1;
+            case RevisionSource::SMU:
                 this->revision = (smcReadReg32Cz(0xC0014044) >> 9) & 0xF;
-                if ((this->revision >= 0xC8 && this->revision <= 0xCE) ||
-                    (this->revision >= 0xE1 && this->revision <= 0xE6)) {
-                    this->chipVariant = ChipVariant::Bristol;
-                    DBGLOG("LRed", "Chip type Carrizo, Bristol variant");
-                } else {
-                    this->chipVariant = ChipVariant::Carrizo;
-                    DBGLOG("LRed", "Chip type Carrizo, Carrizo variant");
-                }
-                break;
-            case 0x98E4:
-                this->chipType = ChipType::Stoney;
-                this->chipVariant = ChipVariant::Stoney;
-                this->gcn3 = true;
-                this->stoney = true;
-                this->enumeratedRevision = 0x61;
-                this->revision = (smcReadReg32Cz(0xC0014044) >> 9) & 0xF;
-                this->familyId = AMDGPU_FAMILY_CZ;
-                DBGLOG("LRed", "Chip type Stoney, Stoney variant");
-                //! R4 and up iGPUs have 3 compute units while the others have 2 CUs, hence the chip variations
-                this->stoney3CU = this->pciRevision <= 0x81 ||
-                                  (this->pciRevision >= 0xC0 && this->pciRevision < 0xD0) ||
-                                  (this->pciRevision >= 0xD9 && this->pciRevision < 0xDB) || this->pciRevision >= 0xE9;
-                DBGLOG("LRed", "Chip is a %dCU model", this->stoney3CU ? 3 : 2);
                 break;
             default:
-                PANIC("LRed", "Unknown device ID 0x%X", deviceId);
+                break;
         }
+
+        if (chipHasStraps(this->chipType)) {
+            const auto *straps = lookupStraps(this->chipType, this->revision);
+            PANIC_COND(!straps, "LRed", "Unknown %s revision ID 0x%X", chipTypeNames[static_cast<int>(this->chipType)],
+                this->revision);
+            this->chipVariant = straps->chipVariant;
+            this->enumeratedRevision = straps->enumeratedRevision;
+        }
+
+        const auto *revisionRange = lookupRevisionRange(this->deviceId, this->pciRevision);
+        if (revisionRange) {
+            if (revisionRange->chipVariant != ChipVariant::Unknown) { this->chipVariant = revisionRange->chipVariant; }
+            if (revisionRange->cuCount) { this->cuCount = revisionRange->cuCount; }
+        }
+
+        //! R4 and up Stoney iGPUs have 3 compute units while the others have 2 CUs
+        this->stoney3CU = this->stoney && this->cuCount == 3;
+        DBGLOG("LRed", "Chip type %s, %s variant, %dCU model", chipTypeNames[static_cast<int>(this->chipType)],
+            chipVariantNames[static_cast<int>(this->chipVariant)], this->cuCount);
         DBGLOG_COND(this->gcn3, "LRed", "iGPU is GCN 3 derivative");
         //! Why ChipType instead of ChipVariant? For mullins we set it as 'Godavari', which is technically just
         //! Kalindi+, by the looks of AMDGPU code
@@ -271,7 +246,341 @@ void LRed::setRMMIOIfNecessary() {
             (LRed::callback->chipType == ChipType::Kalindi) ?
                 static_cast<uint32_t>(LRed::callback->enumeratedRevision) :
                 static_cast<uint32_t>(LRed::callback->enumeratedRevision) + LRed::callback->revision;
+        this->applyPowerGating(chip);
+        //! Before the accelerator starts, so that selecting SEs/SHs can't land in the middle of its own sequences
+        this->detectGFXTopology();
+    }
+}
+
+//! The GART is how the GPU reaches system memory on these APUs, amdgpu's flat 1GB runs out long before RAM does.
+//! Opt-in, `lredgart=<MB>` sets the size and `lredgart=0` gives it half of the memory the carve-out leaves to macOS.
+//! Without it the GART keeps amdgpu's size.
+void LRed::computeGARTSize() {
+    UInt64 size = CIK_DEFAULT_GART_SIZE;
+    UInt32 sizeMB = 0;
+    if (!PE_parse_boot_argn("lredgart", &sizeMB, sizeof(sizeMB))) { return; }
+    if (sizeMB) {
+        UInt64 requested = static_cast<UInt64>(sizeMB) << 20;
+        if (requested >= APU_MIN_GART_SIZE && requested <= APU_MAX_GART_SIZE) {
+            size = requested;
+        } else {
+            SYSLOG("LRed", "Ignoring lredgart=%u, the GART must be %lluMB to %lluMB", sizeMB, APU_MIN_GART_SIZE >> 20,
+                APU_MAX_GART_SIZE >> 20);
+        }
+    } else {
+        UInt64 ram = 0;
+        size_t ramLen = sizeof(ram);
+        if (!sysctlbyname("hw.memsize", &ram, &ramLen, nullptr, 0) && ram > this->memSize) {
+            UInt64 target = (ram - this->memSize) / 2;
+            while ((size << 1) <= target && (size << 1) <= APU_MAX_GART_SIZE) { size <<= 1; }
+        }
+        DBGLOG("LRed", "GART sized for %lluMB of RAM", ram >> 20);
+    }
+
+    this->gartSize = size;
+    SYSLOG("LRed", "GART: Size %lluMB, Start: 0x%llx", size >> 20, APU_COMMON_GART_PADDR);
+
+    auto *dict = OSDictionary::withCapacity(2);
+    if (!dict) { return; }
+    auto *base = OSNumber::withNumber(APU_COMMON_GART_PADDR, 64);
+    if (base) { dict->setObject("Base", base); }
+    OSSafeReleaseNULL(base);
+    auto *sizeNum = OSNumber::withNumber(size, 64);
+    if (sizeNum) { dict->setObject("Size", sizeNum); }
+    OSSafeReleaseNULL(sizeNum);
+    this->iGPU->setProperty("GART", dict);
+    OSSafeReleaseNULL(dict);
+}
+
+//! Enable the blocks amdgpu's pg_flags gate, unless set through DeviceProperties. Blocks amdgpu doesn't gate are left
+//! at CAIL's default. Where amdgpu gates nothing at all, every knob is turned off.
+void LRed::applyPowerGating(const ChipInfo &chip) {
+    static const struct {
+        UInt32 feature;
+        const char *name;
+    } knobs[] = {
+        {PowerGatingGfx, "CAIL,CAIL_DisableGfxCGPowerGating"},
+        {PowerGatingGfxStaticMG, "CAIL,CAIL_DisableStaticGfxMGPowerGating"},
+        {PowerGatingGfxPipeline, "CAIL,CAIL_DisableGFXPipelinePowerGating"},
+        {PowerGatingCP, "CAIL,CAIL_DisableCPPowerGating"},
+        {PowerGatingUVD, "CAIL,CAIL_DisableUVDPowerGating"},
+        {PowerGatingVCE, "CAIL,CAIL_DisableVCEPowerGating"},
+    };
+
+    UInt32 gating = chip.powerGating;
+    //! amdgpu keeps power gating off on Carrizo A0
+    bool disableAll = this->chipType == ChipType::Carrizo && this->chipVariant != ChipVariant::Bristol &&
+                      !this->revision;
+    if (checkKernelArgument("-LRedNoPowerGating")) { disableAll = true; }
+
+    for (auto &knob : knobs) {
+        if (this->iGPU->getProperty(knob.name) || (!disableAll && !(gating & knob.feature))) { continue; }
+        UInt32 disable = disableAll ? 1 : 0;
+        this->iGPU->setProperty(knob.name, &disable, sizeof(disable));
+    }
+    DBGLOG("LRed", "Power gating features: 0x%X%s", gating, disableAll ? " (all disabled)" : "");
+}
+
+void LRed::tuneDisplayConfig(OSDictionary *atyConfig) {
+    //! DAL allocates the compressed surface in the carve-out and drops FBC itself on modes it can't compress
+    bool fbc = OSDynamicCast(OSBoolean, atyConfig->getObject("CFG_USE_FBC")) == kOSBooleanTrue;
+    if (checkKernelArgument("-LRedFBC")) {
+        fbc = true;
+    } else if (checkKernelArgument("-LRedNoFBC")) {
+        fbc = false;
+    }
+    atyConfig->setObject("CFG_USE_FBC", fbc ? kOSBooleanTrue : kOSBooleanFalse);
+    //! What DAL was asked for, it may still leave FBC off per mode
+    this->iGPU->setProperty("FBC Requested", fbc);
+
+    auto *info = this->getVBIOSDataTable<IGPSystemInfoV1_8>(ATOM_DATA_TABLE_INTEGRATED_SYSTEM_INFO);
+    if (!info || info->formatRev != 1 || (info->contentRev != 8 && info->contentRev != 9) ||
+        info->structureSize <= __builtin_offsetof(IGPSystemInfoV1_8, umaChannelCount)) {
+        DBGLOG("LRed", "No usable IntegratedSystemInfo, keeping the default display watermarks");
+        return;
+    }
+
+    //! DAL derives the watermarks and stutter margins itself, they keep the XML defaults.
+    //! Only stutter is turned off on single-channel UMA, where half the bandwidth is left to refill the display buffer
+    //! after a self-refresh exit, so that is where underflow shows first. It costs idle power and nothing else.
+    UInt8 channels = info->umaChannelCount;
+    DBGLOG("LRed", "Memory type %d, %d channel(s)", info->memoryType & 0xF, channels);
+    if (channels == 1) { atyConfig->setObject("CFG_USE_STUTTER", kOSBooleanFalse); }
+}
+
+const GFXTopology &LRed::getGFXTopology() { return this->gfxTopology; }
+
+void LRed::detectGFXTopology() {
+    auto &topology = this->gfxTopology;
+    //! Every APU we support has a single SE with a single SH. Prefer what the VBIOS reports if it has a GFX_Info table.
+    topology.seCount = 1;
+    topology.shPerSE = 1;
+    topology.maxCUPerSH = this->cuCount;
+    auto *gfxInfo = this->getVBIOSDataTable<ATOMGFXInfoV2_1>(ATOM_DATA_TABLE_GFX_INFO);
+    if (gfxInfo && gfxInfo->formatRev == 2 && gfxInfo->contentRev == 1 && gfxInfo->maxShaderEngines &&
+        gfxInfo->maxSHPerSE && gfxInfo->maxCUPerSH) {
+        DBGLOG("LRed", "GFX_Info: SEs: %d, SHs per SE: %d, CUs per SH: %d", gfxInfo->maxShaderEngines,
+            gfxInfo->maxSHPerSE, gfxInfo->maxCUPerSH);
+        topology.seCount = gfxInfo->maxShaderEngines > GFX_MAX_SE ? GFX_MAX_SE : gfxInfo->maxShaderEngines;
+        topology.shPerSE = gfxInfo->maxSHPerSE > GFX_MAX_SH_PER_SE ? GFX_MAX_SH_PER_SE : gfxInfo->maxSHPerSE;
+        topology.maxCUPerSH = gfxInfo->maxCUPerSH;
+    }
+
+    topology.cuPerSH = 0;
+    topology.activeCUCount = 0;
+    topology.rbsPerSE = this->rbsPerSE;
+    topology.activeRBMask = 0;
+    UInt32 rbsPerSH = topology.rbsPerSE / topology.shPerSE;
+    if (!rbsPerSH) { rbsPerSH = 1; }
+    UInt32 rbMask = (1U << rbsPerSH) - 1;
+    //! INACTIVE_CUS is 16 bits wide
+    UInt32 cuMask = topology.maxCUPerSH >= 16 ? 0xFFFF : (1U << topology.maxCUPerSH) - 1;
+    IOLockLock(this->grbmIndexLock);
+    for (UInt32 se = 0; se < topology.seCount; se++) {
+        for (UInt32 sh = 0; sh < topology.shPerSE; sh++) {
+            this->selectSESH(se, sh);
+            UInt32 inactive = this->readReg32(mmCC_GC_SHADER_ARRAY_CONFIG) |
+                              this->readReg32(mmGC_USER_SHADER_ARRAY_CONFIG);
+            inactive = (inactive & SHADER_ARRAY_CONFIG__INACTIVE_CUS_MASK) >> SHADER_ARRAY_CONFIG__INACTIVE_CUS__SHIFT;
+            UInt32 bitmap = ~inactive & cuMask;
+            UInt32 count = __builtin_popcount(bitmap);
+            topology.activeCUBitmap[se][sh] = bitmap;
+            topology.activeCUCount += count;
+            if (count > topology.cuPerSH) { topology.cuPerSH = count; }
+
+            UInt32 rbDisable =
+                this->readReg32(mmCC_RB_BACKEND_DISABLE) | this->readReg32(mmGC_USER_RB_BACKEND_DISABLE);
+            rbDisable =
+                (rbDisable & RB_BACKEND_DISABLE__BACKEND_DISABLE_MASK) >> RB_BACKEND_DISABLE__BACKEND_DISABLE__SHIFT;
+            topology.activeRBMask |= (~rbDisable & rbMask) << ((se * topology.shPerSE + sh) * rbsPerSH);
+        }
+    }
+    this->selectSESH(0xFFFFFFFF, 0xFFFFFFFF);
+    IOLockUnlock(this->grbmIndexLock);
+
+    //! All CUs reported as harvested means the read went nowhere, trust Devices.csv instead.
+    if (!topology.activeCUCount) {
+        SYSLOG("LRed", "Failed to read the active CU bitmap, assuming %d CUs", this->cuCount);
+        topology.seCount = 1;
+        topology.shPerSE = 1;
+        topology.maxCUPerSH = this->cuCount;
+        topology.cuPerSH = this->cuCount;
+        topology.activeCUCount = this->cuCount;
+        topology.activeCUBitmap[0][0] = (1U << this->cuCount) - 1;
     }
+    SYSLOG_COND(topology.activeCUCount != this->cuCount, "LRed", "Fused CU count %d differs from the expected %d",
+        topology.activeCUCount, this->cuCount);
+    this->computeRasterConfig();
+    DBGLOG("LRed", "GFX topology: SEs: %d, SHs per SE: %d, CUs per SH: %d, active CUs: %d, RBs: 0x%X",
+        topology.seCount, topology.shPerSE, topology.cuPerSH, topology.activeCUCount, topology.activeRBMask);
+
+    auto *dict = OSDictionary::withCapacity(8);
+    if (!dict) { return; }
+    auto *bitmap = OSData::withBytes(topology.activeCUBitmap, sizeof(topology.activeCUBitmap));
+    const struct {
+        const char *name;
+        UInt32 value;
+    } numbers[] = {
+        {"SECount", topology.seCount},
+        {"SHPerSE", topology.shPerSE},
+        {"CUPerSH", topology.cuPerSH},
+        {"ActiveCUCount", topology.activeCUCount},
+        {"ActiveRBMask", topology.activeRBMask},
+        {"RasterConfig", topology.rasterConfig[0]},
+        {"RasterConfig1", topology.rasterConfig1},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 32);
+        if (num) { dict->setObject(entry.name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    if (bitmap) { dict->setObject("ActiveCUBitmap", bitmap); }
+    OSSafeReleaseNULL(bitmap);
+    this->iGPU->setProperty("GFX Topology", dict);
+    OSSafeReleaseNULL(dict);
+}
+
+//! See amdgpu's gfx_v7_0_setup_rb and gfx_v7_0_write_harvested_raster_configs
+void LRed::computeRasterConfig() {
+    auto &topology = this->gfxTopology;
+    const UInt32 base = getChipInfo(this->chipType).rasterConfig;
+    UInt32 rbCount = topology.rbsPerSE * topology.seCount;
+    if (rbCount > 16) { rbCount = 16; }
+    topology.rasterConfig1 = 0;
+    for (auto &config : topology.rasterConfig) { config = base; }
+    //! Nothing harvested, or the read went nowhere
+    UInt32 rbMask = topology.activeRBMask;
+    if (!rbMask || static_cast<UInt32>(__builtin_popcount(rbMask)) >= rbCount) { return; }
+
+    UInt32 rbPerSE = rbCount / topology.seCount;
+    UInt32 rbPerPkr = rbCount / topology.seCount / topology.shPerSE;
+    if (rbPerPkr > 2) { rbPerPkr = 2; }
+    UInt32 seMask[GFX_MAX_SE];
+    seMask[0] = ((1U << rbPerSE) - 1) & rbMask;
+    for (UInt32 se = 1; se < GFX_MAX_SE; se++) { seMask[se] = (seMask[se - 1] << rbPerSE) & rbMask; }
+
+    if (topology.seCount > 2 && ((!seMask[0] && !seMask[1]) || (!seMask[2] && !seMask[3]))) {
+        topology.rasterConfig1 &= ~PA_SC_RASTER_CONFIG_1__SE_PAIR_MAP_MASK;
+        topology.rasterConfig1 |= (!seMask[0] && !seMask[1] ? RASTER_CONFIG_MAP_3 : RASTER_CONFIG_MAP_0)
+                                  << PA_SC_RASTER_CONFIG_1__SE_PAIR_MAP__SHIFT;
+    }
+
+    for (UInt32 se = 0; se < topology.seCount; se++) {
+        UInt32 config = base;
+        UInt32 pkr0Mask = ((1U << rbPerPkr) - 1) << (se * rbPerSE);
+        UInt32 pkr1Mask = (pkr0Mask << rbPerPkr) & rbMask;
+        pkr0Mask &= rbMask;
+        UInt32 idx = (se / 2) * 2;
+
+        if (topology.seCount > 1 && (!seMask[idx] || !seMask[idx + 1])) {
+            config &= ~PA_SC_RASTER_CONFIG__SE_MAP_MASK;
+            config |= (seMask[idx] ? RASTER_CONFIG_MAP_0 : RASTER_CONFIG_MAP_3) << PA_SC_RASTER_CONFIG__SE_MAP__SHIFT;
+        }
+
+        if (rbPerSE > 2 && (!pkr0Mask || !pkr1Mask)) {
+            config &= ~PA_SC_RASTER_CONFIG__PKR_MAP_MASK;
+            config |= (pkr0Mask ? RASTER_CONFIG_MAP_0 : RASTER_CONFIG_MAP_3) << PA_SC_RASTER_CONFIG__PKR_MAP__SHIFT;
+        }
+
+        if (rbPerSE >= 2) {
+            UInt32 rb0Mask = (1U << (se * rbPerSE)) & rbMask;
+            UInt32 rb1Mask = (1U << (se * rbPerSE + 1)) & rbMask;
+            if (!rb0Mask || !rb1Mask) {
+                config &= ~PA_SC_RASTER_CONFIG__RB_MAP_PKR0_MASK;
+                config |= (rb0Mask ? RASTER_CONFIG_MAP_0 : RASTER_CONFIG_MAP_3)
+                          << PA_SC_RASTER_CONFIG__RB_MAP_PKR0__SHIFT;
+            }
+            if (rbPerSE > 2) {
+                rb0Mask = (1U << (se * rbPerSE + rbPerPkr)) & rbMask;
+                rb1Mask = (1U << (se * rbPerSE + rbPerPkr + 1)) & rbMask;
+                if (!rb0Mask || !rb1Mask) {
+                    config &= ~PA_SC_RASTER_CONFIG__RB_MAP_PKR1_MASK;
+                    config |= (rb0Mask ? RASTER_CONFIG_MAP_0 : RASTER_CONFIG_MAP_3)
+                              << PA_SC_RASTER_CONFIG__RB_MAP_PKR1__SHIFT;
+                }
+            }
+        }
+        topology.rasterConfig[se] = config;
+    }
+}
+
+void LRed::programRasterConfig() {
+    auto &topology = this->getGFXTopology();
+    IOLockLock(this->grbmIndexLock);
+    for (UInt32 se = 0; se < topology.seCount; se++) {
+        this->selectSESH(se, 0xFFFFFFFF);
+        this->writeReg32(mmPA_SC_RASTER_CONFIG, topology.rasterConfig[se]);
+        this->writeReg32(mmPA_SC_RASTER_CONFIG_1, topology.rasterConfig1);
+    }
+    this->selectSESH(0xFFFFFFFF, 0xFFFFFFFF);
+    IOLockUnlock(this->grbmIndexLock);
+}
+
+const AddrConfig &LRed::getAddrConfig() {
+    if (UNLIKELY(!this->addrConfig.tilePipes)) { this->detectAddrConfig(); }
+    return this->addrConfig;
+}
+
+void LRed::detectAddrConfig() {
+    auto &config = this->addrConfig;
+    const auto &chip = getChipInfo(this->chipType);
+    const UInt32 fixedMask = ~GB_ADDR_CONFIG__ROW_SIZE_MASK;
+    UInt32 value = this->readReg32(mmGB_ADDR_CONFIG);
+    UInt32 rowSize = (value & GB_ADDR_CONFIG__ROW_SIZE_MASK) >> GB_ADDR_CONFIG__ROW_SIZE__SHIFT;
+    //! AddrLib has to describe the layout the hardware actually uses. Nothing reprograms GB_ADDR_CONFIG and its
+    //! HDP/DMIF/SDMA mirrors after the VBIOS, so a mismatch with amdgpu's golden value is only reported.
+    if (value == 0xFFFFFFFF || rowSize > 2) {
+        SYSLOG("LRed", "GB_ADDR_CONFIG 0x%X is invalid, using the golden 0x%X", value, chip.goldenGBAddrConfig);
+        value = chip.goldenGBAddrConfig;
+    } else if ((value & fixedMask) != (chip.goldenGBAddrConfig & fixedMask)) {
+        SYSLOG("LRed", "GB_ADDR_CONFIG 0x%X differs from the golden 0x%X beyond the row size, keeping it", value,
+            chip.goldenGBAddrConfig);
+    }
+    config.gbAddrConfig = value;
+
+    config.tileTable = chip.gcn3 ? &gfx8APUTileModes : &gfx7APUTileModes;
+    //! GB_ADDR_CONFIG.ROW_SIZE 0-2 is 1-4KB, TILE_SPLIT 4-6 is 1-4KB
+    UInt32 rowSizeSplit = ((value & GB_ADDR_CONFIG__ROW_SIZE_MASK) >> GB_ADDR_CONFIG__ROW_SIZE__SHIFT) + 4;
+    for (size_t i = 0; i < GB_TILE_MODE_COUNT; i++) {
+        config.tileModes[i] = resolveTileSplit(config.tileTable->tileModes[i], rowSizeSplit);
+    }
+    //! CiLib's own guess is by family and doesn't know about our APUs, the table is authoritative.
+    config.tilePipes = tileModePipes(config.tileModes[0]);
+
+    UInt32 ramCfg = this->readReg32(mmMC_ARB_RAMCFG);
+    if (ramCfg == 0xFFFFFFFF) {
+        SYSLOG("LRed", "Failed to read MC_ARB_RAMCFG, assuming 8 banks and 1 rank");
+        ramCfg = 1 << MC_ARB_RAMCFG__NOOFBANK__SHIFT;
+    }
+    config.noOfBanks = (ramCfg & MC_ARB_RAMCFG__NOOFBANK_MASK) >> MC_ARB_RAMCFG__NOOFBANK__SHIFT;
+    config.noOfRanks = (ramCfg & MC_ARB_RAMCFG__NOOFRANKS_MASK) >> MC_ARB_RAMCFG__NOOFRANKS__SHIFT;
+    //! 3 is reserved, AddrLib rejects it
+    if (config.noOfBanks > 2) {
+        SYSLOG("LRed", "MC_ARB_RAMCFG.NOOFBANK is invalid, assuming 8 banks");
+        config.noOfBanks = 1;
+    }
+
+    DBGLOG("LRed", "AddrLib: GB_ADDR_CONFIG: 0x%X, pipes: %d, banks: %d, ranks: %d", config.gbAddrConfig,
+        config.tilePipes, 4 << config.noOfBanks, 1 << config.noOfRanks);
+
+    auto *dict = OSDictionary::withCapacity(4);
+    if (!dict) { return; }
+    const struct {
+        const char *name;
+        UInt32 value;
+    } numbers[] = {
+        {"GBAddrConfig", config.gbAddrConfig},
+        {"Pipes", config.tilePipes},
+        {"Banks", 4U << config.noOfBanks},
+        {"Ranks", 1U << config.noOfRanks},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 32);
+        if (num) { dict->setObject(entry.name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    this->iGPU->setProperty("AddrLib Config", dict);
+    OSSafeReleaseNULL(dict);
 }
 
 void LRed::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
@@ -291,6 +600,11 @@ void LRed::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t a
             {"__ZN21AppleMCCSControlCello5probeEP9IOServicePi", wrapFunctionReturnZero},
         };
         patcher.routeMultiple(index, request, address, size);
+    } else if (kextIOPCIFamily.loadIndex == index) {
+        KernelPatcher::RouteRequest request {"__ZN11IOPCIDevice13setPropertiesEP8OSObject", wrapPCIDeviceSetProperties,
+            this->orgPCIDeviceSetProperties};
+        SYSLOG_COND(!patcher.routeMultiple(index, &request, 1, address, size), "LRed",
+            "Failed to route IOPCIDevice::setProperties, runtime performance profiles are unavailable");
     } else if (support.processKext(patcher, index, address, size)) {
         DBGLOG("LRed", "Processed Support");
     } else if (hwlibs.processKext(patcher, index, address, size)) {
@@ -335,6 +649,31 @@ static ApplePanelData appleBacklightData[] = {
 
 size_t LRed::wrapFunctionReturnZero() { return 0; }
 
+//! IORegistryEntrySetCFProperties is open to any process, so only administrators may change the SMU limits.
+//! The profile is applied from the SMU thread call, the caller mustn't spin on the mailbox.
+IOReturn LRed::wrapPCIDeviceSetProperties(IOPCIDevice *that, OSObject *properties) {
+    auto *dict = OSDynamicCast(OSDictionary, properties);
+    auto *profile = dict ? OSDynamicCast(OSNumber, dict->getObject("LRedPerfProfile")) : nullptr;
+    if (that != callback->iGPU || !profile) {
+        return FunctionCast(wrapPCIDeviceSetProperties, callback->orgPCIDeviceSetProperties)(that, properties);
+    }
+
+    if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess) {
+        return kIOReturnNotPrivileged;
+    }
+    if (!SMU::callback->queuePerfProfile(static_cast<PerfProfile>(profile->unsigned32BitValue()))) {
+        return kIOReturnBadArgument;
+    }
+
+    if (dict->getCount() == 1) { return kIOReturnSuccess; }
+    auto *rest = OSDictionary::withDictionary(dict);
+    if (!rest) { return kIOReturnNoMemory; }
+    rest->removeObject("LRedPerfProfile");
+    auto ret = FunctionCast(wrapPCIDeviceSetProperties, callback->orgPCIDeviceSetProperties)(that, rest);
+    OSSafeReleaseNULL(rest);
+    return ret;
+}
+
 bool LRed::wrapApplePanelSetDisplay(IOService *that, IODisplay *display) {
     static bool once = false;
     if (!once) {
@@ -369,7 +708,4 @@ bool LRed::wrapApplePanelSetDisplay(IOService *that, IODisplay *display) {
     return result;
 }
 
-void LRed::signalFBDumpDeviceInfo() { 
-    fb.dumpAllFramebuffers();
-    fb.fbDumpDevProps();
-}
+void LRed::signalFBDumpDeviceInfo() { fb.scheduleDump(); }
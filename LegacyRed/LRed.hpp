@@ -4,34 +4,37 @@
 #pragma once
 #include "AMDCommon.hpp"
 #include "ATOMBIOS.hpp"
+#include "DeviceDB.hpp"
 #include "Firmware.hpp"
+#include "TileModes.hpp"
 #include <Headers/kern_iokit.hpp>
+#include <IOKit/IOLocks.h>
 #include <IOKit/acpi/IOACPIPlatformExpert.h>
 #include <IOKit/graphics/IOFramebuffer.h>
 #include <IOKit/pci/IOPCIDevice.h>
 
-//! GFX core codenames
-enum struct ChipType : UInt32 {
-    Spectre = 0,    //! Kaveri
-    Spooky,         //! Kaveri 2? downgraded from Spectre core
-    Kalindi,        //! Kabini/Bhavani
-    Godavari,       //! Mullins
-    Carrizo,
-    Stoney,
-    Unknown,
+//! Shader engine/array layout as fused, see amdgpu's gfx_v7_0_get_cu_info/gfx_v8_0_get_cu_info
+struct GFXTopology {
+    UInt32 seCount {0};
+    UInt32 shPerSE {0};
+    UInt32 maxCUPerSH {0};
+    UInt32 cuPerSH {0};    //! Most active CUs found in a single SH
+    UInt32 activeCUCount {0};
+    UInt32 activeCUBitmap[GFX_MAX_SE][GFX_MAX_SH_PER_SE] {};
+    UInt32 rbsPerSE {0};
+    UInt32 activeRBMask {0};    //! amdgpu's backend_enable_mask
+    UInt32 rasterConfig[GFX_MAX_SE] {};
+    UInt32 rasterConfig1 {0};
 };
 
-//! Front-end consumer names, includes non-consumer names as-well
-enum struct ChipVariant : UInt32 {
-    Kaveri = 0,
-    Kabini,
-    Temash,
-    Bhavani,
-    Mullins,
-    Carrizo,
-    Bristol,    //! Bristol is actually just a Carrizo+, hence why it isn't in ChipType
-    Stoney,
-    Unknown,
+//! What AddrLib is created with, see Mesa's amdgpu_addr_create
+struct AddrConfig {
+    UInt32 gbAddrConfig {0};
+    UInt32 tilePipes {0};
+    UInt32 noOfBanks {0};    //! MC_ARB_RAMCFG.NOOFBANK, 4 << n banks
+    UInt32 noOfRanks {0};    //! MC_ARB_RAMCFG.NOOFRANKS, 1 << n ranks
+    const TileModeTable *tileTable {nullptr};
+    UInt32 tileModes[GB_TILE_MODE_COUNT] {};    //! `tileTable` with the row size split resolved
 };
 
 //! Hack
@@ -87,23 +90,16 @@ class LRed {
     void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
     void setRMMIOIfNecessary();
     void signalFBDumpDeviceInfo();
+    const GFXTopology &getGFXTopology();
+    const AddrConfig &getAddrConfig();
+    void programRasterConfig();
+    void tuneDisplayConfig(OSDictionary *atyConfig);
 
     private:
-    //! Why not inject VCE & UVD firmware on Godavari and lower ASICs?
-    //! Because the firmware is the exact same.
-    //! I'm serious, they use the same binary.
-    static const char *getVCEPrefix() {
-        PANIC_COND(callback->chipType == ChipType::Unknown, "LRed", "Unknown chip type");
-        static const char *vcePrefix[] = {"ativce02", "ativce02", "ativce02", "ativce02", "amde31a", "amde34a"};
-        return vcePrefix[static_cast<int>(callback->chipType)];
-    }
+    //! See Devices.csv for why most of these are the same.
+    static const char *getVCEPrefix() { return getChipInfo(callback->chipType).vcePrefix; }
 
-    static const char *getUVDPrefix() {
-        PANIC_COND(callback->chipType == ChipType::Unknown, "LRed", "Unknown chip type");
-        static const char *uvdPrefix[] = {"ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cz",
-            "ativvaxy_stn"};
-        return uvdPrefix[static_cast<int>(callback->chipType)];
-    }
+    static const char *getUVDPrefix() { return getChipInfo(callback->chipType).uvdPrefix; }
 
     bool getVBIOSFromVFCT(IOPCIDevice *obj) {
         DBGLOG("LRed", "Fetching VBIOS from VFCT table");
@@ -193,6 +189,14 @@ class LRed {
         }
     }
 
+    //! Callers hold `grbmIndexLock` until broadcast is restored
+    void selectSESH(UInt32 se, UInt32 sh) {
+        UInt32 val = GRBM_GFX_INDEX__INSTANCE_BROADCAST_WRITES_MASK;
+        val |= (se == 0xFFFFFFFF) ? GRBM_GFX_INDEX__SE_BROADCAST_WRITES_MASK : (se << GRBM_GFX_INDEX__SE_INDEX__SHIFT);
+        val |= (sh == 0xFFFFFFFF) ? GRBM_GFX_INDEX__SH_BROADCAST_WRITES_MASK : (sh << GRBM_GFX_INDEX__SH_INDEX__SHIFT);
+        this->writeReg32(mmGRBM_GFX_INDEX, val);
+    }
+
     UInt32 smcReadReg32Cz(UInt32 reg) {
         this->writeReg32(mmMP0PUB_IND_INDEX, reg);
         return this->readReg32(mmMP0PUB_IND_DATA);
@@ -220,6 +224,12 @@ class LRed {
     bool gcn3 {false};
     bool stoney3CU {false};
     bool stoney {false};
+    UInt8 cuCount {0};
+    UInt8 rbsPerSE {0};
+    GFXTopology gfxTopology {};
+    //! Serialises our SE/SH selections with the accelerator's GRBM_GFX_INDEX writes
+    IOLock *grbmIndexLock {nullptr};
+    AddrConfig addrConfig {};
     UInt64 fbOffset {0};
     IOMemoryMap *rmmio {nullptr};
     volatile UInt32 *rmmioPtr {nullptr};
@@ -234,11 +244,20 @@ class LRed {
     UInt64 vramEnd {0};
     UInt64 mcLocation {0};
     UInt64 memSize {0};
+    UInt64 gartSize {CIK_DEFAULT_GART_SIZE};
 
     mach_vm_address_t orgApplePanelSetDisplay {0};
+    mach_vm_address_t orgPCIDeviceSetProperties {0};
+
+    void detectGFXTopology();
+    void computeRasterConfig();
+    void detectAddrConfig();
+    void applyPowerGating(const ChipInfo &chip);
+    void computeGARTSize();
 
     static size_t wrapFunctionReturnZero();
     static bool wrapApplePanelSetDisplay(IOService *that, IODisplay *display);
+    static IOReturn wrapPCIDeviceSetProperties(IOPCIDevice *that, OSObject *properties);
 };
 
 /* ---- Patches ---- */
@@ -0,0 +1,321 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "SMU.hpp"
+#include "LRed.hpp"
+#include <Headers/kern_api.hpp>
+
+SMU *SMU::callback = nullptr;
+
+void SMU::init() {
+    callback = this;
+    this->mailboxLock = IOLockAlloc();
+    this->queueLock = IOLockAlloc();
+    this->smcIndexLock = IOLockAlloc();
+    this->worker = thread_call_allocate(processQueue, this);
+    this->perfProfileCall = thread_call_allocate(
+        [](thread_call_param_t param0, thread_call_param_t) { static_cast<SMU *>(param0)->applyPerfProfile(); }, this);
+    PANIC_COND(!this->mailboxLock || !this->queueLock || !this->smcIndexLock || !this->worker ||
+                   !this->perfProfileCall,
+        "SMU", "Failed to allocate the SMU client");
+
+    UInt32 profile = 0;
+    if (PE_parse_boot_argn("lredperf", &profile, sizeof(profile))) {
+        if (profile < static_cast<UInt32>(PerfProfile::Unknown)) {
+            this->perfProfile = static_cast<PerfProfile>(profile);
+        } else {
+            SYSLOG("SMU", "Invalid performance profile %d", profile);
+        }
+    }
+}
+
+//! Only the outermost send takes the lock. smum's parameter variant may go through the plain one once it has
+//! written the argument, which would otherwise wait on its own caller.
+bool SMU::lockMailbox() {
+    if (__atomic_load_n(&this->mailboxOwner, __ATOMIC_RELAXED) == current_thread()) { return false; }
+    IOLockLock(this->mailboxLock);
+    __atomic_store_n(&this->mailboxOwner, current_thread(), __ATOMIC_RELAXED);
+    return true;
+}
+
+void SMU::unlockMailbox(bool locked) {
+    if (!locked) { return; }
+    __atomic_store_n(&this->mailboxOwner, nullptr, __ATOMIC_RELAXED);
+    IOLockUnlock(this->mailboxLock);
+}
+
+//! PowerPlay's own sends take the mailbox lock too, so neither side sees the other's argument or response
+UInt32 SMU::wrapSendMsgToSmc(void *smum, UInt32 msgId) {
+    bool locked = callback->lockMailbox();
+    callback->smum = smum;
+    auto ret = FunctionCast(wrapSendMsgToSmc, callback->orgSendMsgToSmc)(smum, msgId);
+    callback->unlockMailbox(locked);
+    return ret;
+}
+
+UInt32 SMU::wrapSendMsgToSmcWithParameter(void *smum, UInt32 msgId, UInt32 param) {
+    bool locked = callback->lockMailbox();
+    callback->smum = smum;
+    auto ret = FunctionCast(wrapSendMsgToSmcWithParameter, callback->orgSendMsgToSmcWithParameter)(smum, msgId, param);
+    callback->unlockMailbox(locked);
+    return ret;
+}
+
+//! PowerPlay is being (re)created, whatever it handed us before may be gone
+void SMU::invalidatePowerPlayHandles() {
+    bool locked = this->lockMailbox();
+    this->smum = nullptr;
+    this->maxSclkLevel = 0;
+    this->unlockMailbox(locked);
+    IOLockLock(this->smcIndexLock);
+    this->cgsDevice = nullptr;
+    IOLockUnlock(this->smcIndexLock);
+}
+
+UInt32 SMU::wrapCgsReadIndRegister(void *cgsDevice, UInt32 space, UInt32 index) {
+    if (space != CGS_IND_REG__SMC) {
+        return FunctionCast(wrapCgsReadIndRegister, callback->orgCgsReadIndRegister)(cgsDevice, space, index);
+    }
+    callback->cgsDevice = cgsDevice;
+    IOLockLock(callback->smcIndexLock);
+    auto ret = FunctionCast(wrapCgsReadIndRegister, callback->orgCgsReadIndRegister)(cgsDevice, space, index);
+    IOLockUnlock(callback->smcIndexLock);
+    return ret;
+}
+
+void SMU::wrapCgsWriteIndRegister(void *cgsDevice, UInt32 space, UInt32 index, UInt32 value) {
+    if (space != CGS_IND_REG__SMC) {
+        FunctionCast(wrapCgsWriteIndRegister, callback->orgCgsWriteIndRegister)(cgsDevice, space, index, value);
+        return;
+    }
+    callback->cgsDevice = cgsDevice;
+    IOLockLock(callback->smcIndexLock);
+    FunctionCast(wrapCgsWriteIndRegister, callback->orgCgsWriteIndRegister)(cgsDevice, space, index, value);
+    IOLockUnlock(callback->smcIndexLock);
+}
+
+bool SMU::readSMCRegister(UInt32 reg, UInt32 &value) {
+    if (!this->orgCgsReadIndRegister) { return false; }
+    IOLockLock(this->smcIndexLock);
+    if (!this->cgsDevice) {
+        IOLockUnlock(this->smcIndexLock);
+        return false;
+    }
+    value = reinterpret_cast<t_cgsReadIndRegister>(this->orgCgsReadIndRegister)(this->cgsDevice, CGS_IND_REG__SMC, reg);
+    IOLockUnlock(this->smcIndexLock);
+    return true;
+}
+
+UInt32 SMU::sendMessage(UInt32 msg, UInt32 param, UInt32 *response) {
+    if (!this->orgSendMsgToSmcWithParameter) { return SMUResultFailed; }
+    //! SMU8 moved the SMC mailbox argument to the MP1 SRBM2P registers
+    const UInt32 argReg = LRed::callback->gcn3 ? mmMP1_SMN_C2PMSG_82 : mmSMC_MSG_ARG_0;
+
+    bool locked = this->lockMailbox();
+    if (!this->smum) {
+        this->unlockMailbox(locked);
+        SYSLOG("SMU", "Message 0x%X sent before PowerPlay's SMU manager is known", msg);
+        return SMUResultFailed;
+    }
+    UInt64 start = 0, end = 0;
+    clock_get_uptime(&start);
+
+    //! smum returns 0 on success, it has already waited for and checked the response register
+    auto sendMsg = reinterpret_cast<t_sendMsgToSmcWithParameter>(this->orgSendMsgToSmcWithParameter);
+    UInt32 result = sendMsg(this->smum, msg, param) ? SMUResultFailed : SMUResultOK;
+    if (response && result == SMUResultOK) { *response = LRed::callback->readReg32(argReg); }
+
+    clock_get_uptime(&end);
+    UInt64 ns = 0;
+    absolutetime_to_nanoseconds(end - start, &ns);
+    if (msg < MaxTrackedMessage) {
+        auto &entry = this->stats[msg];
+        entry.count += 1;
+        if (result != SMUResultOK) { entry.failures += 1; }
+        entry.totalNs += ns;
+        if (ns > entry.maxNs) { entry.maxNs = ns; }
+    }
+    this->unlockMailbox(locked);
+
+    SYSLOG_COND(result != SMUResultOK, "SMU", "Message 0x%X (param 0x%X) failed", msg, param);
+    return result;
+}
+
+bool SMU::queueMessage(UInt32 msg, UInt32 param, t_SMUCompletion completion, void *ctx) {
+    IOLockLock(this->queueLock);
+    if (this->queueCount == QueueSize) {
+        this->queueOverflows += 1;
+        IOLockUnlock(this->queueLock);
+        SYSLOG("SMU", "Queue full, dropping message 0x%X", msg);
+        return false;
+    }
+    this->queue[(this->queueHead + this->queueCount) % QueueSize] = {msg, param, completion, ctx};
+    this->queueCount += 1;
+    IOLockUnlock(this->queueLock);
+    thread_call_enter(this->worker);
+    return true;
+}
+
+void SMU::processQueue(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<SMU *>(param0);
+    while (true) {
+        IOLockLock(that->queueLock);
+        if (!that->queueCount) {
+            IOLockUnlock(that->queueLock);
+            break;
+        }
+        auto message = that->queue[that->queueHead];
+        that->queueHead = (that->queueHead + 1) % QueueSize;
+        that->queueCount -= 1;
+        IOLockUnlock(that->queueLock);
+
+        UInt32 response = 0;
+        UInt32 result = that->sendMessage(message.msg, message.param, &response);
+        if (message.completion) { message.completion(message.ctx, message.msg, result, response); }
+    }
+    that->publishStats();
+}
+
+void SMU::publishStats() {
+    auto *dict = OSDictionary::withCapacity(8);
+    if (!dict) { return; }
+
+    char name[16];
+    IOLockLock(this->mailboxLock);
+    for (UInt32 msg = 0; msg < MaxTrackedMessage; msg++) {
+        auto &entry = this->stats[msg];
+        if (!entry.count) { continue; }
+        auto *msgDict = OSDictionary::withCapacity(4);
+        if (!msgDict) { continue; }
+        const struct {
+            const char *name;
+            UInt64 value;
+        } numbers[] = {
+            {"Count", entry.count},
+            {"Failures", entry.failures},
+            {"AvgUs", entry.totalNs / entry.count / 1000},
+            {"MaxUs", entry.maxNs / 1000},
+        };
+        for (auto &number : numbers) {
+            auto *num = OSNumber::withNumber(number.value, 64);
+            if (num) { msgDict->setObject(number.name, num); }
+            OSSafeReleaseNULL(num);
+        }
+        snprintf(name, arrsize(name), "0x%X", msg);
+        dict->setObject(name, msgDict);
+        OSSafeReleaseNULL(msgDict);
+    }
+    IOLockUnlock(this->mailboxLock);
+
+    auto *overflows = OSNumber::withNumber(this->queueOverflows, 32);
+    if (overflows) { dict->setObject("QueueOverflows", overflows); }
+    OSSafeReleaseNULL(overflows);
+    LRed::callback->iGPU->setProperty("SMU Stats", dict);
+    OSSafeReleaseNULL(dict);
+}
+
+//! PowerPlay calls this at init and on every resume, its DPM setup is done once it returns
+int SMU::wrapEnableDynamicStateManagement(void *hwmgr) {
+    auto ret = FunctionCast(wrapEnableDynamicStateManagement, callback->orgEnableDynamicStateManagement)(hwmgr);
+    if (!ret) {
+        __atomic_store_n(&callback->dpmEnabled, true, __ATOMIC_RELEASE);
+        thread_call_enter(callback->perfProfileCall);
+    }
+    return ret;
+}
+
+//! Suspend or DPM reset, the SMU forgets our limits along with its DPM state
+int SMU::wrapDisableDynamicStateManagement(void *hwmgr) {
+    __atomic_store_n(&callback->dpmEnabled, false, __ATOMIC_RELEASE);
+    thread_call_cancel(callback->perfProfileCall);
+    auto ret = FunctionCast(wrapDisableDynamicStateManagement, callback->orgDisableDynamicStateManagement)(hwmgr);
+    callback->perfProfileOverridden = false;
+    callback->maxSclkLevel = 0;
+    return ret;
+}
+
+bool SMU::queuePerfProfile(PerfProfile profile) {
+    if (profile >= PerfProfile::Unknown) { return false; }
+    if (!this->orgEnableDynamicStateManagement) {
+        SYSLOG("SMU", "PowerPlay's DPM hooks are missing, performance profiles are unavailable");
+        return false;
+    }
+    this->perfProfile = profile;
+    thread_call_enter(this->perfProfileCall);
+    return true;
+}
+
+bool SMU::applyPerfProfile() {
+    //! Picked up by the next DPM enable
+    if (!__atomic_load_n(&this->dpmEnabled, __ATOMIC_ACQUIRE)) {
+        this->publishPerfProfile();
+        return false;
+    }
+    //! Nothing of ours to undo, PowerTune is in charge
+    if (this->perfProfile == PerfProfile::Default && !this->perfProfileOverridden) {
+        this->publishPerfProfile();
+        return true;
+    }
+    //! SMU7 on Kaveri/Kabini uses DPM_ForceState and friends instead
+    if (!LRed::callback->gcn3) {
+        SYSLOG("SMU", "Performance profiles are only implemented for SMU8");
+        return false;
+    }
+
+    if (!this->maxSclkLevel) {
+        UInt32 level = 0;
+        if (this->sendMessage(PPSMC_MSG_GetMaxSclkLevel, 0, &level) != SMUResultOK) {
+            SYSLOG("SMU", "Failed to get the max sclk level, performance profile not applied");
+            this->publishPerfProfile();
+            return false;
+        }
+        this->maxSclkLevel = level;
+    }
+
+    //! Lower the minimum first so the soft limits never cross.
+    //! Default puts back what PowerPlay leaves after enabling DPM: the full sclk range with the low memory P-state.
+    UInt32 minLevel = 0, maxLevel = this->maxSclkLevel;
+    bool lowMemoryPstate = true;
+    switch (this->perfProfile) {
+        case PerfProfile::MaxPerformance:
+            minLevel = this->maxSclkLevel;
+            lowMemoryPstate = false;
+            break;
+        case PerfProfile::PowerSave:
+            maxLevel = 0;
+            break;
+        default:
+            break;
+    }
+
+    bool ok = this->sendMessage(PPSMC_MSG_SetSclkSoftMin, 0) == SMUResultOK;
+    ok &= this->sendMessage(PPSMC_MSG_SetSclkSoftMax, maxLevel) == SMUResultOK;
+    if (minLevel) { ok &= this->sendMessage(PPSMC_MSG_SetSclkSoftMin, minLevel) == SMUResultOK; }
+    ok &= this->sendMessage(lowMemoryPstate ? PPSMC_MSG_EnableLowMemoryPstate : PPSMC_MSG_DisableLowMemoryPstate,
+              1) == SMUResultOK;
+
+    DBGLOG("SMU", "Applied performance profile %s: sclk levels %d-%d, low memory P-state %s",
+        perfProfileNames[static_cast<UInt32>(this->perfProfile)], minLevel, maxLevel,
+        lowMemoryPstate ? "allowed" : "disallowed");
+    SYSLOG_COND(!ok, "SMU", "Failed to apply performance profile %s",
+        perfProfileNames[static_cast<UInt32>(this->perfProfile)]);
+    this->perfProfileOverridden = this->perfProfile != PerfProfile::Default;
+    this->publishPerfProfile();
+    return ok;
+}
+
+void SMU::publishPerfProfile() {
+    auto *dict = OSDictionary::withCapacity(4);
+    if (!dict) { return; }
+    auto *name = OSString::withCString(perfProfileNames[static_cast<UInt32>(this->perfProfile)]);
+    if (name) { dict->setObject("Profile", name); }
+    OSSafeReleaseNULL(name);
+    auto *maxSclkLevel = OSNumber::withNumber(this->maxSclkLevel, 32);
+    if (maxSclkLevel) { dict->setObject("MaxSclkLevel", maxSclkLevel); }
+    OSSafeReleaseNULL(maxSclkLevel);
+    bool dpmEnabled = __atomic_load_n(&this->dpmEnabled, __ATOMIC_ACQUIRE);
+    dict->setObject("DPMEnabled", dpmEnabled ? kOSBooleanTrue : kOSBooleanFalse);
+    dict->setObject("Overridden", this->perfProfileOverridden ? kOSBooleanTrue : kOSBooleanFalse);
+    LRed::callback->iGPU->setProperty("SMU Perf Profile", dict);
+    OSSafeReleaseNULL(dict);
+}
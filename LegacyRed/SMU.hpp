@@ -0,0 +1,121 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLocks.h>
+#include <kern/thread_call.h>
+
+//! See amdgpu's smu8_smumgr.c and kv_smc.c
+enum SMUResult : UInt32 {
+    SMUResultOK = 0x1,
+    SMUResultCmdRejectedBusy = 0xFC,
+    SMUResultCmdRejectedPrereq = 0xFD,
+    SMUResultUnknownCmd = 0xFE,
+    SMUResultFailed = 0xFF,
+};
+
+//! See amdgpu's smu8.h/cz_ppsmc.h
+enum SMU8Message : UInt32 {
+    PPSMC_MSG_SetSclkSoftMin = 0x12,
+    PPSMC_MSG_SetSclkSoftMax = 0x13,
+    PPSMC_MSG_DisableLowMemoryPstate = 0x2E,
+    PPSMC_MSG_EnableLowMemoryPstate = 0x2F,
+    PPSMC_MSG_GetMaxSclkLevel = 0x3B,
+};
+
+//! Selected with `lredperf=<index>` or at runtime through the iGPU's `LRedPerfProfile` property
+enum struct PerfProfile : UInt32 {
+    Default = 0,       //! Leave DPM to PowerTune, putting its limits back if another profile changed them
+    MaxPerformance,    //! Pin sclk to the top DPM level and keep the NB in its high P-state
+    Balanced,          //! Full sclk range, NB P-state switching allowed
+    PowerSave,         //! Pin sclk to the bottom DPM level
+    Unknown,
+};
+
+static const char *perfProfileNames[] = {"Default", "MaxPerformance", "Balanced", "PowerSave"};
+
+//! Called from the SMU worker thread
+using t_SMUCompletion = void (*)(void *ctx, UInt32 msg, UInt32 result, UInt32 response);
+
+struct SMUMessageStats {
+    UInt32 count;
+    UInt32 failures;
+    UInt64 totalNs;
+    UInt64 maxNs;
+};
+
+class SMU {
+    friend class HWLibs;
+
+    public:
+    static SMU *callback;
+    void init();
+
+    //! Goes through PowerPlay's smum path, blocks until the SMU answers. `response` gets the argument register.
+    //! Fails until PowerPlay has sent its first message, which is when its SMU manager becomes known.
+    UInt32 sendMessage(UInt32 msg, UInt32 param = 0, UInt32 *response = nullptr);
+    //! Through PowerPlay's cgs accessor and under its index/data lock, false until PowerPlay has used it once.
+    bool readSMCRegister(UInt32 reg, UInt32 &value);
+    //! For hooks which mustn't spin on the mailbox, false if the queue is full.
+    bool queueMessage(UInt32 msg, UInt32 param = 0, t_SMUCompletion completion = nullptr, void *ctx = nullptr);
+    void publishStats();
+
+    //! Applies the profile from the perf profile thread call once PowerPlay has enabled DPM, and again on each
+    //! re-enable. False if the profile is invalid or PowerPlay's DPM hooks are missing.
+    bool queuePerfProfile(PerfProfile profile);
+
+    private:
+    struct QueuedMessage {
+        UInt32 msg;
+        UInt32 param;
+        t_SMUCompletion completion;
+        void *ctx;
+    };
+
+    static constexpr size_t QueueSize = 16;
+    static constexpr size_t MaxTrackedMessage = 0x80;
+
+    //! Held around every mailbox transaction, PowerPlay's included, see the smum wrappers
+    IOLock *mailboxLock {nullptr};
+    thread_t mailboxOwner {nullptr};
+    IOLock *queueLock {nullptr};
+    thread_call_t worker {nullptr};
+    QueuedMessage queue[QueueSize] {};
+    size_t queueHead {0};
+    size_t queueCount {0};
+    SMUMessageStats stats[MaxTrackedMessage] {};
+    UInt32 queueOverflows {0};
+    PerfProfile perfProfile {PerfProfile::Default};
+    thread_call_t perfProfileCall {nullptr};
+    UInt32 maxSclkLevel {0};
+    bool dpmEnabled {false};
+    //! Our limits are in the SMU, Default has something to restore
+    bool perfProfileOverridden {false};
+    mach_vm_address_t orgEnableDynamicStateManagement {0};
+    mach_vm_address_t orgDisableDynamicStateManagement {0};
+
+    void *smum {nullptr};
+    mach_vm_address_t orgSendMsgToSmc {0};
+    mach_vm_address_t orgSendMsgToSmcWithParameter {0};
+
+    //! Held around every access to the SMC index/data pair made through cgs, PowerPlay's included
+    IOLock *smcIndexLock {nullptr};
+    void *cgsDevice {nullptr};
+    mach_vm_address_t orgCgsReadIndRegister {0};
+    mach_vm_address_t orgCgsWriteIndRegister {0};
+
+    static UInt32 wrapCgsReadIndRegister(void *cgsDevice, UInt32 space, UInt32 index);
+    static void wrapCgsWriteIndRegister(void *cgsDevice, UInt32 space, UInt32 index, UInt32 value);
+    bool lockMailbox();
+    void unlockMailbox(bool locked);
+    void invalidatePowerPlayHandles();
+    static UInt32 wrapSendMsgToSmc(void *smum, UInt32 msgId);
+    static UInt32 wrapSendMsgToSmcWithParameter(void *smum, UInt32 msgId, UInt32 param);
+    static void processQueue(thread_call_param_t param0, thread_call_param_t param1);
+    static int wrapEnableDynamicStateManagement(void *hwmgr);
+    static int wrapDisableDynamicStateManagement(void *hwmgr);
+    bool applyPerfProfile();
+    void publishPerfProfile();
+};
@@ -3,7 +3,10 @@
 
 #include "Support.hpp"
 #include "ATOMBIOS.hpp"
+#include "Framebuffer.hpp"
+#include "GFXCon.hpp"
 #include "LRed.hpp"
+#include "X4000.hpp"
 #include <Headers/kern_api.hpp>
 
 static const char *pathRadeonSupport = "/System/Library/Extensions/AMDSupport.kext/Contents/MacOS/AMDSupport";
@@ -13,11 +16,80 @@ static KernelPatcher::KextInfo kextRadeonSupport = {"com.apple.kext.AMDSupport",
 
 Support *Support::callback = nullptr;
 
+//! FNV-1a, used on plain structs of integers
+static UInt32 fnv1a(const void *data, size_t size) {
+    UInt32 hash = 0x811C9DC5;
+    const auto *bytes = static_cast<const UInt8 *>(data);
+    for (size_t i = 0; i < size; i++) { hash = (hash ^ bytes[i]) * 0x01000193; }
+    return hash;
+}
+
 void Support::init() {
     callback = this;
+    this->validatedTimingsLock = IOLockAlloc();
+    this->linkTraceLock = IOLockAlloc();
+    PANIC_COND(!this->validatedTimingsLock || !this->linkTraceLock, "Support", "Failed to allocate locks");
     lilu.onKextLoadForce(&kextRadeonSupport);
 }
 
+void Support::processPatcher(KernelPatcher &patcher) {
+    if (!checkKernelArgument("-LRedMSI") || !LRed::callback->iGPU) { return; }
+    this->msiIndex = findMSIIndex();
+    if (this->msiIndex <= 0) {
+        SYSLOG("Support", "The iGPU has no MSI source, -LRedMSI has no effect");
+        return;
+    }
+    if (!this->routeIGPUInterruptSlots(patcher)) {
+        SYSLOG("Support", "Failed to route the iGPU's interrupt functions, staying on the legacy source");
+        this->msiIndex = -1;
+    }
+}
+
+//! AtiFb reaches these through its provider, the iGPU, whose class inherits them from IOService.
+//! Rather than routing IOService's code, which every driver in the kernel runs, swap the slots in the iGPU's vtable.
+//! The wrappers still pass through anything that isn't the iGPU, as other devices of the same class share the vtable.
+bool Support::routeIGPUInterruptSlots(KernelPatcher &patcher) {
+    static constexpr size_t MaxVTableSlots = 1024;
+    struct {
+        const char *symbol;
+        mach_vm_address_t wrapper;
+        mach_vm_address_t &org;
+        size_t slot;
+    } slots[] = {
+        {"__ZN9IOService17registerInterruptEiP8OSObjectPFvS1_PvPS_iES2_",
+            reinterpret_cast<mach_vm_address_t>(wrapRegisterInterrupt), this->orgRegisterInterrupt, 0},
+        {"__ZN9IOService19unregisterInterruptEi", reinterpret_cast<mach_vm_address_t>(wrapUnregisterInterrupt),
+            this->orgUnregisterInterrupt, 0},
+        {"__ZN9IOService15enableInterruptEi", reinterpret_cast<mach_vm_address_t>(wrapEnableInterrupt),
+            this->orgEnableInterrupt, 0},
+        {"__ZN9IOService16disableInterruptEi", reinterpret_cast<mach_vm_address_t>(wrapDisableInterrupt),
+            this->orgDisableInterrupt, 0},
+    };
+    auto *vtable = *reinterpret_cast<mach_vm_address_t **>(LRed::callback->iGPU);
+    for (auto &entry : slots) {
+        auto address = patcher.solveSymbol(KernelPatcher::KernelID, entry.symbol);
+        if (!address) {
+            patcher.clearError();
+            return false;
+        }
+        entry.slot = MaxVTableSlots;
+        for (size_t i = 0; i < MaxVTableSlots; i++) {
+            if (vtable[i] == address) {
+                entry.slot = i;
+                break;
+            }
+        }
+        //! Overridden by the iGPU's class, the call doesn't end up where we expect
+        if (entry.slot == MaxVTableSlots) { return false; }
+        entry.org = address;
+    }
+    PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "Support",
+        "Failed to enable kernel writing");
+    for (auto &entry : slots) { vtable[entry.slot] = entry.wrapper; }
+    MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
+    return true;
+}
+
 bool Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
     if (kextRadeonSupport.loadIndex == index) {
         LRed::callback->setRMMIOIfNecessary();
@@ -37,13 +109,16 @@ bool Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_
         }
 
         if (LRed::callback->gcn3) {
-            SolveRequestPlus solveRequests[] = {
-                {"__ZN21AtiFbInterruptManager30initializePulseBasedInterruptsEb", this->IHInitPulseBasedInterrupts},
-                {"__ZN21AtiFbInterruptManager32acknowledgeOutstandingInterruptsEv",
-                    this->IHAcknowledgeAllOutStandingInterrupts},
-            };
-            PANIC_COND(!SolveRequestPlus::solveAll(patcher, index, solveRequests, address, size), "Support",
-                "Failed to solve symbols for CZ IH");
+            SolveRequestPlus request {"__ZN21AtiFbInterruptManager32acknowledgeOutstandingInterruptsEv",
+                this->IHAcknowledgeAllOutStandingInterrupts};
+            PANIC_COND(!request.solve(patcher, index, address, size), "Support", "Failed to solve symbols for CZ IH");
+
+            if (checkKernelArgument("-LRedMSI")) {
+                RouteRequestPlus request {"__ZN21AtiFbInterruptManager30initializePulseBasedInterruptsEb",
+                    wrapIHInitPulseBasedInterrupts, this->orgIHInitPulseBasedInterrupts};
+                PANIC_COND(!request.route(patcher, index, address, size), "Support",
+                    "Failed to route initializePulseBasedInterrupts");
+            }
         }
 
         RouteRequestPlus requests[] = {
@@ -55,6 +130,7 @@ bool Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_
             {"__ZN13ATIController10doGPUPanicEPKcz", wrapDoGPUPanic},
             {"__ZN30AtiObjectInfoTableInterface_V14initERN21AtiDataTableBaseClass17DataTableInitInfoE",
                 wrapObjectInfoTableInit, this->orgObjectInfoTableInit},
+            {"__ZN13ATIController5startEP9IOService", wrapATIControllerStart, this->orgATIControllerStart},
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "Support",
             "Failed to route symbols");
@@ -80,6 +156,19 @@ bool Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_
     return false;
 }
 
+//! The Stoney personality lives in our Info.plist and the others come from IOCatalogue, this catches them all
+//! before DAL reads its configuration.
+bool Support::wrapATIControllerStart(IOService *that, IOService *provider) {
+    auto *atyConfig = OSDynamicCast(OSDictionary, that->getProperty("aty_config"));
+    auto *tuned = atyConfig ? OSDictionary::withDictionary(atyConfig) : nullptr;
+    if (tuned) {
+        LRed::callback->tuneDisplayConfig(tuned);
+        that->setProperty("aty_config", tuned);
+        OSSafeReleaseNULL(tuned);
+    }
+    return FunctionCast(wrapATIControllerStart, callback->orgATIControllerStart)(that, provider);
+}
+
 IOReturn Support::wrapPopulateDeviceMemory(void *that, UInt32 reg) {
     FunctionCast(wrapPopulateDeviceMemory, callback->orgPopulateDeviceMemory)(that, reg);
     return kIOReturnSuccess;
@@ -88,23 +177,129 @@ IOReturn Support::wrapPopulateDeviceMemory(void *that, UInt32 reg) {
 bool Support::wrapNotifyLinkChange(void *atiDeviceControl, kAGDCRegisterLinkControlEvent_t event, void *eventData,
     UInt32 eventFlags) {
     LRed::callback->signalFBDumpDeviceInfo();
+
+    auto *cmd = static_cast<AGDCValidateDetailedTiming_t *>(eventData);
+    if (event == kAGDCValidateDetailedTiming) {
+        if (callback->lookupValidatedTiming(cmd)) {
+            callback->traceLinkEvent(event, eventData, eventFlags, 0, true, true);
+            return true;
+        }
+    } else {
+        //! The GPU was powered down, its rings come back without doorbells until X4000 reinitialises them
+        if (event == kAGDCRegisterLinkChangeWakeProbe) { X4000::callback->resetDoorbells(); }
+        //! Whatever sits on the link may have changed, so may the timings it accepts
+        callback->invalidateValidatedTimings();
+    }
+
+    UInt64 start = mach_absolute_time();
     auto ret = FunctionCast(wrapNotifyLinkChange, callback->orgNotifyLinkChange)(atiDeviceControl, event, eventData,
         eventFlags);
+    callback->traceLinkEvent(event, eventData, eventFlags, mach_absolute_time() - start, ret, false);
 
     DBGLOG("Support", "FB Link has changed! Event: %d, Data: %p, Flags: 0x%x", event, eventData, eventFlags);
 
     if (event == kAGDCValidateDetailedTiming) {
-        auto cmd = static_cast<AGDCValidateDetailedTiming_t *>(eventData);
         DBGLOG("Support", "AGDCValidateDetailedTiming %u -> %d (%u)", cmd->framebufferIndex, ret, cmd->modeStatus);
         if (ret == false || cmd->modeStatus < 1 || cmd->modeStatus > 3) {
             cmd->modeStatus = 2;
             ret = true;
         }
+        callback->storeValidatedTiming(cmd);
     }
 
     return ret;
 }
 
+void Support::traceLinkEvent(kAGDCRegisterLinkControlEvent_t event, void *eventData, UInt32 flags, UInt64 duration,
+    bool result, bool cached) {
+    if (event == kAGDCValidateDetailedTiming) {
+        Framebuffer::callback->countValidation(cached);
+    } else {
+        Framebuffer::callback->countLinkChange();
+    }
+    UInt64 now = 0, durationNs = 0;
+    absolutetime_to_nanoseconds(mach_absolute_time(), &now);
+    absolutetime_to_nanoseconds(duration, &durationNs);
+    IOLockLock(this->linkTraceLock);
+    auto &entry = this->linkTrace[this->linkTraceHead++ % LinkTraceSize];
+    entry = {now, static_cast<UInt32>(event), flags, static_cast<UInt32>(durationNs / 1000), result, cached};
+    IOLockUnlock(this->linkTraceLock);
+}
+
+//! Runs from the framebuffer dump thread call, which every link event schedules, never from the AGDC path
+void Support::publishLinkTrace() {
+    LinkTraceEntry entries[LinkTraceSize];
+    IOLockLock(this->linkTraceLock);
+    size_t count = this->linkTraceHead < LinkTraceSize ? this->linkTraceHead : LinkTraceSize;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = this->linkTrace[(this->linkTraceHead - count + i) % LinkTraceSize];
+    }
+    IOLockUnlock(this->linkTraceLock);
+    if (!count) { return; }
+
+    auto *array = OSArray::withCapacity(LinkTraceSize);
+    if (!array) { return; }
+    for (size_t i = 0; i < count; i++) {
+        auto &entry = entries[i];
+        auto *dict = OSDictionary::withCapacity(6);
+        if (!dict) { continue; }
+        const struct {
+            const char *name;
+            UInt64 value;
+        } numbers[] = {
+            {"TimestampMs", entry.timestamp / 1000000},
+            {"Event", entry.event},
+            {"Flags", entry.flags},
+            {"DurationUs", entry.durationUs},
+        };
+        for (auto &number : numbers) {
+            auto *num = OSNumber::withNumber(number.value, 64);
+            if (num) { dict->setObject(number.name, num); }
+            OSSafeReleaseNULL(num);
+        }
+        dict->setObject("Result", entry.result ? kOSBooleanTrue : kOSBooleanFalse);
+        dict->setObject("Cached", entry.cached ? kOSBooleanTrue : kOSBooleanFalse);
+        array->setObject(dict);
+        OSSafeReleaseNULL(dict);
+    }
+    LRed::callback->iGPU->setProperty("AGDC Event Trace", array);
+    OSSafeReleaseNULL(array);
+}
+
+bool Support::lookupValidatedTiming(AGDCValidateDetailedTiming_t *cmd) {
+    if (!cmd || cmd->framebufferIndex >= ValidatedTimingFBCount) { return false; }
+    UInt32 hash = fnv1a(&cmd->timing, sizeof(cmd->timing));
+    bool hit = false;
+    IOLockLock(this->validatedTimingsLock);
+    auto &entry = this->validatedTimings[cmd->framebufferIndex][hash % ValidatedTimingCacheSize];
+    if (entry.valid && entry.hash == hash && !memcmp(&entry.timing, &cmd->timing, sizeof(cmd->timing))) {
+        cmd->modeStatus = entry.modeStatus;
+        hit = true;
+    }
+    IOLockUnlock(this->validatedTimingsLock);
+    return hit;
+}
+
+void Support::storeValidatedTiming(const AGDCValidateDetailedTiming_t *cmd) {
+    if (!cmd || cmd->framebufferIndex >= ValidatedTimingFBCount) { return; }
+    UInt32 hash = fnv1a(&cmd->timing, sizeof(cmd->timing));
+    IOLockLock(this->validatedTimingsLock);
+    auto &entry = this->validatedTimings[cmd->framebufferIndex][hash % ValidatedTimingCacheSize];
+    entry.valid = true;
+    entry.hash = hash;
+    entry.timing = cmd->timing;
+    entry.modeStatus = cmd->modeStatus;
+    IOLockUnlock(this->validatedTimingsLock);
+}
+
+void Support::invalidateValidatedTimings() {
+    IOLockLock(this->validatedTimingsLock);
+    for (auto &fb : this->validatedTimings) {
+        for (auto &entry : fb) { entry.valid = false; }
+    }
+    IOLockUnlock(this->validatedTimingsLock);
+}
+
 bool Support::doNotTestVram([[maybe_unused]] IOService *ctrl, [[maybe_unused]] UInt32 reg,
     [[maybe_unused]] bool retryOnFail) {
     LRed::callback->signalFBDumpDeviceInfo();
@@ -141,12 +336,74 @@ bool Support::wrapObjectInfoTableInit(void *that, void *initdata) {
             conInfoTbl->numberOfObjects--;
         }
     }
+    publishConnectorTopology(conInfoTbl);
     return ret;
 }
 
+void Support::publishConnectorTopology(const ATOMObjTable *table) {
+    auto *array = OSArray::withCapacity(table->numberOfObjects);
+    if (!array) { return; }
+    for (size_t i = 0; i < table->numberOfObjects; i++) {
+        auto *objectID = OSNumber::withNumber(table->objects[i].objectID, 16);
+        if (objectID) { array->setObject(objectID); }
+        OSSafeReleaseNULL(objectID);
+    }
+    LRed::callback->iGPU->setProperty("Connector Topology", array);
+    OSSafeReleaseNULL(array);
+}
+
 void *Support::wrapADCStart(void *that, IOService *provider) {
     SYSLOG("Support", "Enabling AGDC, be warned that this is untested");
     auto ret = FunctionCast(wrapADCStart, callback->orgADCStart)(that, provider);
     getMember<bool>(that, 0x22A) = true;
     return ret;
 }
+
+int Support::findMSIIndex() {
+    int type = 0;
+    for (int i = 0; LRed::callback->iGPU->getInterruptType(i, &type) == kIOReturnSuccess; i++) {
+        if (type & kIOInterruptTypePCIMessaged) { return i; }
+    }
+    return -1;
+}
+
+//! AtiFb registers the IH on source 0, the legacy pin, whatever its flags say.
+//! Move it to the MSI source so that the flags set below describe what is actually wired up.
+int Support::remapInterruptSource(IOService *that, int source) {
+    return (source == 0 && that == LRed::callback->iGPU && callback->msiIndex > 0) ? callback->msiIndex : source;
+}
+
+IOReturn Support::wrapRegisterInterrupt(IOService *that, int source, OSObject *target, IOInterruptAction handler,
+    void *refCon) {
+    return FunctionCast(wrapRegisterInterrupt, callback->orgRegisterInterrupt)(that,
+        remapInterruptSource(that, source), target, handler, refCon);
+}
+
+IOReturn Support::wrapUnregisterInterrupt(IOService *that, int source) {
+    return FunctionCast(wrapUnregisterInterrupt, callback->orgUnregisterInterrupt)(that,
+        remapInterruptSource(that, source));
+}
+
+IOReturn Support::wrapEnableInterrupt(IOService *that, int source) {
+    return FunctionCast(wrapEnableInterrupt, callback->orgEnableInterrupt)(that, remapInterruptSource(that, source));
+}
+
+IOReturn Support::wrapDisableInterrupt(IOService *that, int source) {
+    return FunctionCast(wrapDisableInterrupt, callback->orgDisableInterrupt)(that, remapInterruptSource(that, source));
+}
+
+//! Pulse-based interrupts are the fallback for when the iGPU has no MSI source.
+void Support::wrapIHInitPulseBasedInterrupts(void *that, bool enabled) {
+    if (enabled) {
+        auto &flags = getMember<UInt32>(that, InterruptManagerFields::Flags);
+        if (callback->msiIndex > 0) {
+            DBGLOG("Support", "Using MSI source %d for the IH", callback->msiIndex);
+            flags |= InterruptManagerFlags::MSIEnabled | InterruptManagerFlags::DontUsePulseBasedInterrupts;
+            enabled = false;
+        } else {
+            SYSLOG("Support", "No MSI source on the iGPU, using pulse-based interrupts");
+            flags &= ~(InterruptManagerFlags::MSIEnabled | InterruptManagerFlags::DontUsePulseBasedInterrupts);
+        }
+    }
+    FunctionCast(wrapIHInitPulseBasedInterrupts, callback->orgIHInitPulseBasedInterrupts)(that, enabled);
+}
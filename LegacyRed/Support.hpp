@@ -6,6 +6,7 @@
 #include "ATOMBIOS.hpp"
 #include "PatcherPlus.hpp"
 #include <Headers/kern_util.hpp>
+#include <IOKit/IOLocks.h>
 #include <IOKit/IOService.h>
 
 // Taken from WhateverGreen's kern_agdc.h, used for a wrap in kern_support.cpp
@@ -76,8 +77,24 @@ struct AGDCValidateDetailedTiming_t {
     UInt16 padding3[2];
 };
 
+//! Final `modeStatus` of a validated timing, DAL is asked about the same timings over and over
+struct ValidatedTiming {
+    bool valid;
+    UInt32 hash;
+    AGDCDetailedTimingInformation_t timing;
+    UInt32 modeStatus;
+};
+
+struct LinkTraceEntry {
+    UInt64 timestamp;    //! Nanoseconds of uptime
+    UInt32 event;
+    UInt32 flags;
+    UInt32 durationUs;    //! Time spent in AMDSupport's handler
+    bool result;
+    bool cached;    //! Answered from the timing cache
+};
+
 using t_AcknowledgeAllOutStandingInterrupts = void (*)(void *that);
-using t_InitPulseBasedInterrupts = void (*)(void *that, bool enabled);
 
 class Support {
     friend class GFXCon;
@@ -85,7 +102,9 @@ class Support {
     public:
     static Support *callback;
     void init();
+    void processPatcher(KernelPatcher &patcher);
     bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void publishLinkTrace();
 
     private:
     mach_vm_address_t orgPopulateDeviceMemory {0};
@@ -94,7 +113,33 @@ class Support {
     mach_vm_address_t orgObjectInfoTableInit {0};
     mach_vm_address_t orgADCStart {0};
     t_AcknowledgeAllOutStandingInterrupts IHAcknowledgeAllOutStandingInterrupts {nullptr};
-    t_InitPulseBasedInterrupts IHInitPulseBasedInterrupts {nullptr};
+    mach_vm_address_t orgIHInitPulseBasedInterrupts {0};
+    mach_vm_address_t orgRegisterInterrupt {0};
+    mach_vm_address_t orgUnregisterInterrupt {0};
+    mach_vm_address_t orgEnableInterrupt {0};
+    mach_vm_address_t orgDisableInterrupt {0};
+    //! The iGPU's IOKit interrupt index for MSI, -1 when the IH stays on the legacy source
+    int msiIndex {-1};
+    mach_vm_address_t orgATIControllerStart {0};
+
+    static constexpr size_t ValidatedTimingFBCount = 6;
+    static constexpr size_t ValidatedTimingCacheSize = 16;
+    IOLock *validatedTimingsLock {nullptr};
+    ValidatedTiming validatedTimings[ValidatedTimingFBCount][ValidatedTimingCacheSize] {};
+
+    bool lookupValidatedTiming(AGDCValidateDetailedTiming_t *cmd);
+    void storeValidatedTiming(const AGDCValidateDetailedTiming_t *cmd);
+    void invalidateValidatedTimings();
+
+    static constexpr size_t LinkTraceSize = 32;
+    IOLock *linkTraceLock {nullptr};
+    LinkTraceEntry linkTrace[LinkTraceSize] {};
+    size_t linkTraceHead {0};
+
+    void traceLinkEvent(kAGDCRegisterLinkControlEvent_t event, void *eventData, UInt32 flags, UInt64 duration,
+        bool result, bool cached);
+
+    static void publishConnectorTopology(const ATOMObjTable *table);
 
     static bool wrapNotifyLinkChange(void *atiDeviceControl, kAGDCRegisterLinkControlEvent_t event, void *eventData,
         UInt32 eventFlags);
@@ -104,6 +149,16 @@ class Support {
     static void wrapDoGPUPanic();
     static bool wrapObjectInfoTableInit(void *that, void *initdata);
     static void *wrapADCStart(void *that, IOService *provider);
+    static void wrapIHInitPulseBasedInterrupts(void *that, bool enabled);
+    static int findMSIIndex();
+    bool routeIGPUInterruptSlots(KernelPatcher &patcher);
+    static int remapInterruptSource(IOService *that, int source);
+    static IOReturn wrapRegisterInterrupt(IOService *that, int source, OSObject *target, IOInterruptAction handler,
+        void *refCon);
+    static IOReturn wrapUnregisterInterrupt(IOService *that, int source);
+    static IOReturn wrapEnableInterrupt(IOService *that, int source);
+    static IOReturn wrapDisableInterrupt(IOService *that, int source);
+    static bool wrapATIControllerStart(IOService *that, IOService *provider);
 };
 
 /* ---- Patches ---- */
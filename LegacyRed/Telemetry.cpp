@@ -0,0 +1,138 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "Telemetry.hpp"
+#include "LRed.hpp"
+#include "SMU.hpp"
+#include <Headers/kern_api.hpp>
+
+Telemetry *Telemetry::callback = nullptr;
+
+void Telemetry::init() {
+    callback = this;
+    UInt32 period = 0;
+    if (!PE_parse_boot_argn("lredtelemetry", &period, sizeof(period)) || !period) { return; }
+    if (period < MinPeriodMs) {
+        SYSLOG("Telemetry", "Sampling period %dms is too short, using %dms", period, MinPeriodMs);
+        period = MinPeriodMs;
+    }
+    this->periodMs = period;
+    this->timer = thread_call_allocate(
+        [](thread_call_param_t param0, thread_call_param_t) { static_cast<Telemetry *>(param0)->sample(); }, this);
+    PANIC_COND(!this->timer, "Telemetry", "Failed to allocate the sampler");
+}
+
+void Telemetry::start() {
+    if (!this->timer || this->started) { return; }
+    this->started = true;
+    DBGLOG("Telemetry", "Sampling every %dms", this->periodMs);
+    this->rearm();
+}
+
+void Telemetry::rearm() {
+    UInt64 deadline = 0;
+    clock_interval_to_deadline(this->periodMs, kMillisecondScale, &deadline);
+    thread_call_enter_delayed(this->timer, deadline);
+}
+
+//! See amdgpu's kv_dpm_get_temp and smu8_thermal_get_temperature
+bool Telemetry::readTemperature(SInt32 &temperature) {
+    UInt32 val = 0;
+    if (!LRed::callback->gcn3) {
+        if (!SMU::callback->readSMCRegister(ixKV_THM_TCON_CUR_TMP, val)) { return false; }
+        temperature = val ? (static_cast<SInt32>(val / 8) - 49) * 1000 : 0;
+        return true;
+    }
+    if (!SMU::callback->readSMCRegister(ixTHM_TCON_CUR_TMP, val)) { return false; }
+    auto temp = static_cast<SInt32>((val >> THM_TCON_CUR_TMP__CUR_TEMP__SHIFT) / 8);
+    if (val & THM_TCON_CUR_TMP__CUR_TEMP_RANGE_SEL_MASK) { temp -= 49; }
+    temperature = temp * 1000;
+    return true;
+}
+
+//! See amdgpu's kv_dpm_debugfs_print_current_performance_level.
+//! SMU8 keeps the index at another SMC address, which isn't read until it is verified.
+bool Telemetry::readSclkLevel(UInt32 &level) {
+    if (LRed::callback->gcn3) {
+        level = 0;
+        return true;
+    }
+    UInt32 val = 0;
+    if (!SMU::callback->readSMCRegister(ixKV_TARGET_AND_CURRENT_PROFILE_INDEX, val)) { return false; }
+    level = (val & TARGET_AND_CURRENT_PROFILE_INDEX__CURR_SCLK_INDEX_MASK) >>
+            TARGET_AND_CURRENT_PROFILE_INDEX__CURR_SCLK_INDEX__SHIFT;
+    return true;
+}
+
+void Telemetry::sample() {
+    SInt32 temperature = 0;
+    UInt32 sclkLevel = 0;
+    if (this->readTemperature(temperature) && this->readSclkLevel(sclkLevel)) {
+        auto &entry = this->ring[this->head % RingSize];
+        UInt64 now = 0;
+        absolutetime_to_nanoseconds(mach_absolute_time(), &now);
+        entry.timestamp = now;
+        entry.temperature = temperature;
+        entry.sclkLevel = sclkLevel;
+        entry.guiActive = (LRed::callback->readReg32(mmGRBM_STATUS) & GRBM_STATUS__GUI_ACTIVE_MASK) != 0;
+        __atomic_store_n(&this->head, this->head + 1, __ATOMIC_RELEASE);
+
+        if (this->head % RingSize == 0) { this->publish(); }
+    }
+    this->rearm();
+}
+
+size_t Telemetry::snapshot(TelemetrySample *out, size_t count) {
+    UInt32 written = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+    size_t available = written < RingSize ? written : RingSize;
+    if (count > available) { count = available; }
+    for (size_t i = 0; i < count; i++) { out[i] = this->ring[(written - count + i) % RingSize]; }
+    return count;
+}
+
+void Telemetry::publish() {
+    TelemetrySample samples[RingSize];
+    size_t count = this->snapshot(samples, RingSize);
+    if (!count) { return; }
+
+    SInt32 temperatures[RingSize];
+    UInt32 active = 0, sclkLevelSum = 0, sclkLevelMax = 0;
+    SInt64 temperatureSum = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].guiActive) { active += 1; }
+        sclkLevelSum += samples[i].sclkLevel;
+        if (samples[i].sclkLevel > sclkLevelMax) { sclkLevelMax = samples[i].sclkLevel; }
+        temperatureSum += samples[i].temperature;
+        //! Insertion sort, the ring is tiny
+        size_t j = i;
+        for (; j > 0 && temperatures[j - 1] > samples[i].temperature; j--) { temperatures[j] = temperatures[j - 1]; }
+        temperatures[j] = samples[i].temperature;
+    }
+
+    auto *dict = OSDictionary::withCapacity(10);
+    if (!dict) { return; }
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"PeriodMs", this->periodMs},
+        {"Samples", count},
+        {"WindowMs", (samples[count - 1].timestamp - samples[0].timestamp) / 1000000},
+        {"GUIActivePercent", active * 100 / count},
+        {"TemperatureAvgMilliC", static_cast<UInt64>(temperatureSum / static_cast<SInt64>(count))},
+        {"TemperatureP50MilliC", static_cast<UInt64>(temperatures[count / 2])},
+        {"TemperatureP95MilliC", static_cast<UInt64>(temperatures[(count * 95) / 100])},
+        {"TemperatureMaxMilliC", static_cast<UInt64>(temperatures[count - 1])},
+        {"SclkLevelAvg", sclkLevelSum / count},
+        {"SclkLevelMax", sclkLevelMax},
+    };
+    //! The sclk level is only read on Kaveri/Kabini, see `readSclkLevel`
+    size_t published = LRed::callback->gcn3 ? arrsize(numbers) - 2 : arrsize(numbers);
+    for (size_t i = 0; i < published; i++) {
+        auto *num = OSNumber::withNumber(numbers[i].value, 64);
+        if (num) { dict->setObject(numbers[i].name, num); }
+        OSSafeReleaseNULL(num);
+    }
+    LRed::callback->iGPU->setProperty("GPU Telemetry", dict);
+    OSSafeReleaseNULL(dict);
+}
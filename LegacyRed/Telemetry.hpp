@@ -0,0 +1,46 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+#include <kern/thread_call.h>
+
+struct TelemetrySample {
+    UInt64 timestamp;      //! Nanoseconds of uptime
+    SInt32 temperature;    //! Millidegrees Celsius
+    UInt32 sclkLevel;      //! Current sclk DPM level, PowerPlay owns the level to MHz table. 0 on SMU8.
+    bool guiActive;        //! GRBM_STATUS.GUI_ACTIVE
+};
+
+//! Periodic GPU sampler, strictly opt-in with `lredtelemetry=<period in ms>`.
+//! SMC registers are read through PowerPlay's cgs accessor under its lock, never by poking the index/data pair
+//! behind its back. Until PowerPlay has made its first SMC access no samples are taken.
+//! A sample costs five register accesses, at 100ms that is far below 0.1% of a core.
+class Telemetry {
+    public:
+    static Telemetry *callback;
+    void init();
+    void start();
+
+    //! Copies up to `RingSize` of the newest samples, oldest first. Safe from any thread, the ring is never locked.
+    //! A sample overwritten while being copied is torn, which only matters for the statistics of that one interval.
+    size_t snapshot(TelemetrySample *out, size_t count);
+
+    static constexpr size_t RingSize = 64;
+
+    private:
+    static constexpr UInt32 MinPeriodMs = 10;
+
+    UInt32 periodMs {0};
+    thread_call_t timer {nullptr};
+    bool started {false};
+    TelemetrySample ring[RingSize] {};
+    UInt32 head {0};    //! Total samples written, the producer is the only writer
+
+    bool readTemperature(SInt32 &temperature);
+    bool readSclkLevel(UInt32 &level);
+    void sample();
+    void publish();
+    void rearm();
+};
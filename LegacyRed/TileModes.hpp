@@ -0,0 +1,260 @@
+//! Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+
+//! Tiling tables for our APUs, from amdgpu's gfx_v7_0_tiling_mode_table_init (Kaveri/Kabini/Mullins share one) and
+//! gfx_v8_0_tiling_mode_table_init (Carrizo/Stoney share one). X4000 would otherwise program and hand AddrLib the
+//! tables of the dGPU it thinks it's driving, which disagree on the pipe config and bank counts.
+
+constexpr UInt32 mmGB_TILE_MODE0 = 0x2644;
+constexpr UInt32 mmGB_MACROTILE_MODE0 = 0x2664;
+constexpr size_t GB_TILE_MODE_COUNT = 32;
+constexpr size_t GB_MACROTILE_MODE_COUNT = 16;
+
+enum struct TileArrayMode : UInt32 {
+    LinearGeneral = 0,
+    LinearAligned,
+    Tiled1DThin1,
+    Tiled1DThick,
+    Tiled2DThin1,
+    PRTTiledThin1,
+    PRT2DTiledThin1,
+    Tiled2DThick,
+    Tiled2DXThick,
+    PRTTiledThick,
+    PRT2DTiledThick,
+    PRT3DTiledThin1,
+    Tiled3DThin1,
+    Tiled3DThick,
+    Tiled3DXThick,
+    PRT3DTiledThick,
+};
+
+enum struct TileMicroMode : UInt32 {
+    Display = 0,
+    Thin,
+    Depth,
+    Rotated,
+    Thick,
+};
+
+constexpr UInt32 ADDR_SURF_P2 = 0;
+constexpr UInt32 ADDR_SURF_P4_8x16 = 4;
+constexpr UInt32 ADDR_SURF_P4_16x16 = 5;
+
+//! Not a hardware value, replaced with the split matching GB_ADDR_CONFIG.ROW_SIZE when the table is built
+constexpr UInt32 TILE_SPLIT_ROW_SIZE = 7;
+
+constexpr UInt32 GB_TILE_MODE0__ARRAY_MODE__SHIFT = 0x2;
+constexpr UInt32 GB_TILE_MODE0__PIPE_CONFIG_MASK = 0x7C0;
+constexpr UInt32 GB_TILE_MODE0__PIPE_CONFIG__SHIFT = 0x6;
+constexpr UInt32 GB_TILE_MODE0__TILE_SPLIT_MASK = 0x3800;
+constexpr UInt32 GB_TILE_MODE0__TILE_SPLIT__SHIFT = 0xB;
+constexpr UInt32 GB_TILE_MODE0__MICRO_TILE_MODE_NEW__SHIFT = 0x16;
+constexpr UInt32 GB_TILE_MODE0__SAMPLE_SPLIT__SHIFT = 0x19;
+
+constexpr UInt32 GB_MACROTILE_MODE0__BANK_WIDTH__SHIFT = 0x0;
+constexpr UInt32 GB_MACROTILE_MODE0__BANK_HEIGHT__SHIFT = 0x2;
+constexpr UInt32 GB_MACROTILE_MODE0__MACRO_TILE_ASPECT__SHIFT = 0x4;
+constexpr UInt32 GB_MACROTILE_MODE0__NUM_BANKS__SHIFT = 0x6;
+
+//! `split` and `sampleSplit` are log2 of 64 bytes and of samples respectively.
+constexpr UInt32 tileMode(TileArrayMode mode, UInt32 pipeConfig, TileMicroMode micro, UInt32 split = 0,
+    UInt32 sampleSplit = 0) {
+    return (static_cast<UInt32>(mode) << GB_TILE_MODE0__ARRAY_MODE__SHIFT) |
+           (pipeConfig << GB_TILE_MODE0__PIPE_CONFIG__SHIFT) | (split << GB_TILE_MODE0__TILE_SPLIT__SHIFT) |
+           (static_cast<UInt32>(micro) << GB_TILE_MODE0__MICRO_TILE_MODE_NEW__SHIFT) |
+           (sampleSplit << GB_TILE_MODE0__SAMPLE_SPLIT__SHIFT);
+}
+
+//! All log2, banks is log2 of half the bank count.
+constexpr UInt32 macroTileMode(UInt32 bankWidth, UInt32 bankHeight, UInt32 aspect, UInt32 banks) {
+    return (bankWidth << GB_MACROTILE_MODE0__BANK_WIDTH__SHIFT) |
+           (bankHeight << GB_MACROTILE_MODE0__BANK_HEIGHT__SHIFT) |
+           (aspect << GB_MACROTILE_MODE0__MACRO_TILE_ASPECT__SHIFT) | (banks << GB_MACROTILE_MODE0__NUM_BANKS__SHIFT);
+}
+
+struct TileModeTable {
+    UInt32 tileModes[GB_TILE_MODE_COUNT];
+    UInt32 macroTileModes[GB_MACROTILE_MODE_COUNT];
+    UInt32 skippedTileModes;         //! Bitmask of entries amdgpu leaves to the hardware defaults
+    UInt32 skippedMacroTileModes;    //! Ditto
+};
+
+using TAM = TileArrayMode;
+using TMM = TileMicroMode;
+
+static constexpr TileModeTable gfx7APUTileModes = {
+    {
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 0),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 1),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 2),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 3),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::Tiled1DThin1, ADDR_SURF_P2, TMM::Depth),
+        tileMode(TAM::PRT2DTiledThin1, ADDR_SURF_P2, TMM::Depth, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::LinearGeneral, 0, TMM::Display, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::LinearAligned, ADDR_SURF_P2, TMM::Display),
+        tileMode(TAM::Tiled1DThin1, 0, TMM::Display),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Display, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Display, 0, 3),
+        tileMode(TAM::LinearGeneral, 0, TMM::Display, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::Tiled1DThin1, 0, TMM::Thin),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Thin, 0, 1),
+        tileMode(TAM::Tiled3DThin1, ADDR_SURF_P2, TMM::Thin, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Thin, 0, 3),
+        tileMode(TAM::LinearGeneral, 0, TMM::Display, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::Tiled1DThick, ADDR_SURF_P2, TMM::Thin),
+        tileMode(TAM::Tiled1DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled2DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled3DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::PRTTiledThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::LinearGeneral, 0, TMM::Display, TILE_SPLIT_ROW_SIZE),
+        tileMode(TAM::Tiled2DThick, ADDR_SURF_P2, TMM::Thin),
+        tileMode(TAM::Tiled2DXThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled3DXThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled1DThin1, 0, TMM::Rotated),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Rotated, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Rotated, 0, 3),
+        tileMode(TAM::LinearGeneral, 0, TMM::Display, TILE_SPLIT_ROW_SIZE),
+        0,
+    },
+    {
+        macroTileMode(2, 2, 1, 2),
+        macroTileMode(1, 2, 1, 2),
+        macroTileMode(0, 1, 1, 2),
+        macroTileMode(0, 1, 1, 2),
+        macroTileMode(0, 1, 1, 2),
+        macroTileMode(0, 0, 1, 2),
+        macroTileMode(0, 0, 0, 1),
+        0,
+        macroTileMode(2, 3, 2, 3),
+        macroTileMode(2, 2, 2, 3),
+        macroTileMode(1, 2, 1, 3),
+        macroTileMode(1, 1, 1, 3),
+        macroTileMode(0, 1, 1, 3),
+        macroTileMode(0, 0, 1, 3),
+        macroTileMode(0, 0, 0, 2),
+        0,
+    },
+    0,
+    0,
+};
+
+static constexpr TileModeTable gfx8APUTileModes = {
+    {
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 0),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 1),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 2),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 3),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Depth, 5),
+        tileMode(TAM::Tiled1DThin1, ADDR_SURF_P2, TMM::Depth, 5),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Depth, 5),
+        0,
+        tileMode(TAM::LinearAligned, ADDR_SURF_P2, TMM::Display),
+        tileMode(TAM::Tiled1DThin1, ADDR_SURF_P2, TMM::Display, 0, 1),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Display, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Display, 0, 3),
+        0,
+        tileMode(TAM::Tiled1DThin1, ADDR_SURF_P2, TMM::Thin, 0, 1),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Thin, 0, 1),
+        tileMode(TAM::Tiled3DThin1, ADDR_SURF_P2, TMM::Thin, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Thin, 0, 3),
+        0,
+        tileMode(TAM::Tiled1DThick, ADDR_SURF_P2, TMM::Thin),
+        tileMode(TAM::Tiled1DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled2DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled3DThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::PRTTiledThick, ADDR_SURF_P2, TMM::Thick),
+        0,
+        tileMode(TAM::Tiled2DThick, ADDR_SURF_P2, TMM::Thin),
+        tileMode(TAM::Tiled2DXThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled3DXThick, ADDR_SURF_P2, TMM::Thick),
+        tileMode(TAM::Tiled1DThin1, ADDR_SURF_P2, TMM::Rotated, 0, 1),
+        tileMode(TAM::Tiled2DThin1, ADDR_SURF_P2, TMM::Rotated, 0, 1),
+        tileMode(TAM::PRTTiledThin1, ADDR_SURF_P2, TMM::Rotated, 0, 3),
+        0,
+        0,
+    },
+    {
+        macroTileMode(2, 2, 1, 2),
+        macroTileMode(1, 2, 1, 2),
+        macroTileMode(0, 1, 1, 2),
+        macroTileMode(0, 0, 1, 2),
+        macroTileMode(0, 0, 1, 2),
+        macroTileMode(0, 0, 1, 2),
+        macroTileMode(0, 0, 1, 2),
+        0,
+        macroTileMode(2, 3, 1, 3),
+        macroTileMode(2, 2, 1, 3),
+        macroTileMode(1, 2, 1, 3),
+        macroTileMode(1, 1, 1, 3),
+        macroTileMode(0, 1, 1, 3),
+        macroTileMode(0, 0, 1, 3),
+        macroTileMode(0, 0, 0, 2),
+        0,
+    },
+    (1U << 7) | (1U << 12) | (1U << 17) | (1U << 23),
+    (1U << 7),
+};
+
+//! The words amdgpu's tables program with the golden GB_ADDR_CONFIG (2KB rows), every entry of the tables above is
+//! checked against them.
+static constexpr UInt32 gfx7APUTileModeWords[GB_TILE_MODE_COUNT] = {
+    0x00800010, 0x00800810, 0x00801010, 0x00801810, 0x00802810, 0x00800008, 0x00802818, 0x00002800,
+    0x00000004, 0x00000008, 0x02000010, 0x06000014, 0x00002800, 0x00400008, 0x02400010, 0x02400030,
+    0x06400014, 0x00002800, 0x0040000C, 0x0100000C, 0x0100001C, 0x01000034, 0x01000024, 0x00002800,
+    0x0040001C, 0x01000020, 0x01000038, 0x00C00008, 0x02C00010, 0x06C00014, 0x00002800, 0x00000000,
+};
+static constexpr UInt32 gfx7APUMacroTileModeWords[GB_MACROTILE_MODE_COUNT] = {
+    0x0000009A, 0x00000099, 0x00000094, 0x00000094, 0x00000094, 0x00000090, 0x00000040, 0x00000000,
+    0x000000EE, 0x000000EA, 0x000000D9, 0x000000D5, 0x000000D4, 0x000000D0, 0x00000080, 0x00000000,
+};
+static constexpr UInt32 gfx8APUTileModeWords[GB_TILE_MODE_COUNT] = {
+    0x00800010, 0x00800810, 0x00801010, 0x00801810, 0x00802810, 0x00802808, 0x00802814, 0x00000000,
+    0x00000004, 0x02000008, 0x02000010, 0x06000014, 0x00000000, 0x02400008, 0x02400010, 0x02400030,
+    0x06400014, 0x00000000, 0x0040000C, 0x0100000C, 0x0100001C, 0x01000034, 0x01000024, 0x00000000,
+    0x0040001C, 0x01000020, 0x01000038, 0x02C00008, 0x02C00010, 0x06C00014, 0x00000000, 0x00000000,
+};
+static constexpr UInt32 gfx8APUMacroTileModeWords[GB_MACROTILE_MODE_COUNT] = {
+    0x0000009A, 0x00000099, 0x00000094, 0x00000090, 0x00000090, 0x00000090, 0x00000090, 0x00000000,
+    0x000000DE, 0x000000DA, 0x000000D9, 0x000000D5, 0x000000D4, 0x000000D0, 0x00000080, 0x00000000,
+};
+
+//! `rowSizeSplit` is the TILE_SPLIT matching GB_ADDR_CONFIG.ROW_SIZE
+constexpr UInt32 resolveTileSplit(UInt32 mode, UInt32 rowSizeSplit) {
+    if (((mode & GB_TILE_MODE0__TILE_SPLIT_MASK) >> GB_TILE_MODE0__TILE_SPLIT__SHIFT) != TILE_SPLIT_ROW_SIZE) {
+        return mode;
+    }
+    return (mode & ~GB_TILE_MODE0__TILE_SPLIT_MASK) | (rowSizeSplit << GB_TILE_MODE0__TILE_SPLIT__SHIFT);
+}
+
+constexpr bool tileTableMatches(const TileModeTable &table, const UInt32 (&tileModes)[GB_TILE_MODE_COUNT],
+    const UInt32 (&macroTileModes)[GB_MACROTILE_MODE_COUNT]) {
+    for (size_t i = 0; i < GB_TILE_MODE_COUNT; i++) {
+        if (resolveTileSplit(table.tileModes[i], 5) != tileModes[i]) { return false; }
+    }
+    for (size_t i = 0; i < GB_MACROTILE_MODE_COUNT; i++) {
+        if (table.macroTileModes[i] != macroTileModes[i]) { return false; }
+    }
+    return true;
+}
+
+static_assert(tileTableMatches(gfx7APUTileModes, gfx7APUTileModeWords, gfx7APUMacroTileModeWords),
+    "Kaveri tile mode tables mismatch");
+static_assert(tileTableMatches(gfx8APUTileModes, gfx8APUTileModeWords, gfx8APUMacroTileModeWords),
+    "Carrizo tile mode tables mismatch");
+
+inline UInt32 tileModePipes(UInt32 tileMode) {
+    switch ((tileMode & GB_TILE_MODE0__PIPE_CONFIG_MASK) >> GB_TILE_MODE0__PIPE_CONFIG__SHIFT) {
+        case ADDR_SURF_P2:
+            return 2;
+        case ADDR_SURF_P4_8x16:
+        case ADDR_SURF_P4_16x16:
+            return 4;
+        default:
+            return 0;
+    }
+}
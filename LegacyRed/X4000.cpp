@@ -3,18 +3,12 @@
 
 #include "X4000.hpp"
 #include "LRed.hpp"
-#include "Model.hpp"
 #include <Headers/kern_api.hpp>
 
 static const char *pathRadeonX4000 = "/System/Library/Extensions/AMDRadeonX4000.kext/Contents/MacOS/AMDRadeonX4000";
 static KernelPatcher::KextInfo kextRadeonX4000 {"com.apple.kext.AMDRadeonX4000", &pathRadeonX4000, 1, {}, {},
     KernelPatcher::KextInfo::Unloaded};
 
-/*
- * Misc HW changes to follow up on:
- * - Raster Config, see https://github.com/ROCm/ROCK-Kernel-Driver/blob/8809b4b2efdcb6eb0a9b7fbb9e11ae5f83b3a8fa/drivers/gpu/drm/amd/amdgpu/gfx_v7_0.c#L1603-L1629
- */
-
 X4000 *X4000::callback = nullptr;
 
 void X4000::init() {
@@ -33,6 +27,18 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
 
         this->dumpIBs = checkKernelArgument("-X4KDumpAllIBs");
 
+        //! Opt-in until it has seen more hardware. The doorbell aperture is BAR2, VI APUs need no BIF enablement.
+        if ((stoney || carrizo) && checkKernelArgument("-X4KDoorbells")) {
+            this->doorbellMap = LRed::callback->iGPU->mapDeviceMemoryWithRegister(kIOPCIConfigBaseAddress2);
+            if (this->doorbellMap && this->doorbellMap->getLength()) {
+                this->doorbellPtr = reinterpret_cast<volatile UInt32 *>(this->doorbellMap->getVirtualAddress());
+                DBGLOG("X4000", "Doorbell aperture mapped, size: 0x%llx", this->doorbellMap->getLength());
+            } else {
+                SYSLOG("X4000", "Failed to map the doorbell aperture, using MMIO WPTR updates");
+                OSSafeReleaseNULL(this->doorbellMap);
+            }
+        }
+
         UInt32 *orgChannelTypes = nullptr;
         mach_vm_address_t startHWEngines = 0;
 
@@ -190,11 +196,11 @@ static inline void setHWCapability(void *that, HWCapability capability, T value)
 
 void X4000::wrapSetupAndInitializeHWCapabilities(void *that) {
     DBGLOG("X4000", "setupAndInitializeHWCapabilities: this = %p", that);
-    UInt32 cuPerSh = 2;
-    if (LRed::callback->chipType <= ChipType::Spooky || LRed::callback->chipType == ChipType::Carrizo) { cuPerSh = 8; }
-    setHWCapability<UInt32>(that, HWCapability::SECount, 1);
-    setHWCapability<UInt32>(that, HWCapability::SHPerSE, 1);
-    setHWCapability<UInt32>(that, HWCapability::CUPerSH, cuPerSh);
+    //! Advertise what is actually fused, 3CU Stoney parts used to run with only 2 CUs
+    auto &topology = LRed::callback->getGFXTopology();
+    setHWCapability<UInt32>(that, HWCapability::SECount, topology.seCount);
+    setHWCapability<UInt32>(that, HWCapability::SHPerSE, topology.shPerSE);
+    setHWCapability<UInt32>(that, HWCapability::CUPerSH, topology.cuPerSH);
     FunctionCast(wrapSetupAndInitializeHWCapabilities, callback->orgSetupAndInitializeHWCapabilities)(that);
 
     if (LRed::callback->chipType == ChipType::Stoney) { setHWCapability<bool>(that, HWCapability::Unknown0, true); }
@@ -249,8 +255,27 @@ void X4000::wrapInitializeVMRegs(void *that) {
 }
 
 int X4000::wrapHwlInitGlobalParams(void *that, const void *creationInfo) {
+    auto &config = LRed::callback->getAddrConfig();
+    //! The input is const and owned by the caller, hand AddrLib a copy carrying the decoded register values.
+    auto *input = static_cast<const AddrCreateInput *>(creationInfo);
+    AddrCreateInput patched;
+    if (input->size >= sizeof(AddrCreateInput)) {
+        patched = *input;
+        patched.regValue.gbAddrConfig = config.gbAddrConfig;
+        patched.regValue.noOfBanks = config.noOfBanks;
+        patched.regValue.noOfRanks = config.noOfRanks;
+        patched.regValue.tileConfig = config.tileModes;
+        patched.regValue.noOfEntries = GB_TILE_MODE_COUNT;
+        patched.regValue.macroTileConfig = config.tileTable->macroTileModes;
+        patched.regValue.noOfMacroEntries = GB_MACROTILE_MODE_COUNT;
+        creationInfo = &patched;
+    } else {
+        SYSLOG("X4000", "Unexpected ADDR_CREATE_INPUT size %d, not patching register values", input->size);
+    }
     auto ret = FunctionCast(wrapHwlInitGlobalParams, callback->orgHwlInitGlobalParams)(that, creationInfo);
-    getMember<UInt32>(that, 0x38) = (LRed::callback->chipType == ChipType::Spectre) ? 4 : 2;
+    //! CiLib picks `m_pipes` from its own family checks, which don't know about our APUs.
+    //! Must agree with the pipe config of the tile modes above.
+    getMember<UInt32>(that, 0x38) = config.tilePipes;
     return ret;
 }
 
@@ -286,13 +311,99 @@ bool X4000::wrapAMDSMLVCEInit(void *that) {
 }
 
 //! free dmesg spam for 150$!!!!!!
+struct DoorbellRing {
+    UInt32 baseReg;
+    UInt32 wptrReg;
+    UInt32 controlReg;
+    UInt32 controlVal;
+    UInt32 index;
+    UInt32 haltReg;
+    UInt32 haltMask;
+};
+
+static const DoorbellRing doorbellRings[] = {
+    {mmCP_RB0_BASE, mmCP_RB0_WPTR, mmCP_RB_DOORBELL_CONTROL,
+        CP_RB_DOORBELL_CONTROL__DOORBELL_EN_MASK |
+            ((AMDGPU_DOORBELL_GFX_RING0 << CP_RB_DOORBELL_CONTROL__DOORBELL_OFFSET__SHIFT) &
+                CP_RB_DOORBELL_CONTROL__DOORBELL_OFFSET_MASK),
+        AMDGPU_DOORBELL_GFX_RING0, mmCP_ME_CNTL, CP_ME_CNTL__ME_HALT_MASK | CP_ME_CNTL__PFP_HALT_MASK},
+    {mmSDMA0_GFX_RB_BASE, mmSDMA0_GFX_RB_WPTR, mmSDMA0_GFX_DOORBELL,
+        SDMA0_GFX_DOORBELL__ENABLE_MASK | (AMDGPU_DOORBELL_SDMA_ENGINE0 << SDMA0_GFX_DOORBELL__OFFSET__SHIFT),
+        AMDGPU_DOORBELL_SDMA_ENGINE0, mmSDMA0_F32_CNTL, SDMA0_F32_CNTL__HALT_MASK},
+    {mmSDMA1_GFX_RB_BASE, mmSDMA1_GFX_RB_WPTR, mmSDMA1_GFX_DOORBELL,
+        SDMA0_GFX_DOORBELL__ENABLE_MASK | (AMDGPU_DOORBELL_SDMA_ENGINE1 << SDMA0_GFX_DOORBELL__OFFSET__SHIFT),
+        AMDGPU_DOORBELL_SDMA_ENGINE1, mmSDMA1_F32_CNTL, SDMA0_F32_CNTL__HALT_MASK},
+};
+
+//! Like amdgpu's gfx_v8_0_cp_gfx_resume/sdma_v3_0_gfx_resume, the doorbell is enabled right after X4000 programs the
+//! ring base, which it does on every ring (re)init, including after sleep.
+//! Halting the engine drops it again, so WPTR goes through MMIO until the next ring init.
+void X4000::trackDoorbellState(void *hwRegs, UInt32 addr, UInt32 val) {
+    if (!this->doorbellPtr) { return; }
+    for (size_t i = 0; i < arrsize(doorbellRings); i++) {
+        auto &ring = doorbellRings[i];
+        if (addr == ring.baseReg) {
+            if ((ring.index + 1) * sizeof(UInt32) > this->doorbellMap->getLength()) { return; }
+            DBGLOG("X4000", "Enabling doorbell 0x%X for WPTR 0x%X", ring.index, ring.wptrReg);
+            FunctionCast(wrapAMDHWRegsWrite, this->orgAMDHWRegsWrite)(hwRegs, ring.controlReg, ring.controlVal);
+            __atomic_fetch_or(&this->doorbellsProgrammed, 1U << i, __ATOMIC_RELEASE);
+        } else if (addr == ring.haltReg && (val & ring.haltMask)) {
+            __atomic_fetch_and(&this->doorbellsProgrammed, ~(1U << i), __ATOMIC_RELEASE);
+        }
+    }
+}
+
+//! Power was lost or is about to be, every ring goes back to MMIO WPTR updates until it is reinitialised
+void X4000::resetDoorbells() {
+    if (!this->doorbellPtr) { return; }
+    __atomic_store_n(&this->doorbellsProgrammed, 0, __ATOMIC_RELEASE);
+    DBGLOG("X4000", "Doorbells reset");
+}
+
+//! Turns a WPTR register write into a doorbell write once the ring's doorbell is enabled.
+//! The doorbell takes the same value as the register, dwords for CP and bytes for SDMA.
+bool X4000::ringDoorbell(UInt32 addr, UInt32 val) {
+    if (!this->doorbellPtr) { return false; }
+    UInt32 programmed = __atomic_load_n(&this->doorbellsProgrammed, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < arrsize(doorbellRings); i++) {
+        auto &ring = doorbellRings[i];
+        if (ring.wptrReg != addr) { continue; }
+        if (!(programmed & (1U << i))) { return false; }
+        this->doorbellPtr[ring.index] = val;
+        return true;
+    }
+    return false;
+}
+
 void X4000::wrapAMDHWRegsWrite(void *that, UInt32 addr, UInt32 val) {
     DBGLOG("X4000", "ACCEL REG WRITE >> addr: 0x%x, val: 0x%x", addr, val);
     if (addr == mmSRBM_SOFT_RESET) {
         val &= ~SRBM_SOFT_RESET__SOFT_RESET_MC_MASK;
         DBGLOG("X4000", "Stripping SRBM_SOFT_RESET__SOFT_RESET_MC_MASK bit");
+        callback->resetDoorbells();
+    } else if (callback->ringDoorbell(addr, val)) {
+        return;
+    } else if (addr >= mmGB_TILE_MODE0 && addr < mmGB_TILE_MODE0 + GB_TILE_MODE_COUNT) {
+        auto &config = LRed::callback->getAddrConfig();
+        UInt32 i = addr - mmGB_TILE_MODE0;
+        if (!(config.tileTable->skippedTileModes & (1U << i))) { val = config.tileModes[i]; }
+    } else if (addr >= mmGB_MACROTILE_MODE0 && addr < mmGB_MACROTILE_MODE0 + GB_MACROTILE_MODE_COUNT) {
+        auto *table = LRed::callback->getAddrConfig().tileTable;
+        UInt32 i = addr - mmGB_MACROTILE_MODE0;
+        if (!(table->skippedMacroTileModes & (1U << i))) { val = table->macroTileModes[i]; }
+    } else if (addr == mmGRBM_GFX_INDEX) {
+        IOLockLock(LRed::callback->grbmIndexLock);
+        FunctionCast(wrapAMDHWRegsWrite, callback->orgAMDHWRegsWrite)(that, addr, val);
+        IOLockUnlock(LRed::callback->grbmIndexLock);
+        return;
+    } else if (addr == mmPA_SC_RASTER_CONFIG) {
+        //! The dGPU personality's RB mapping either hangs or idles our harvested RBs
+        val = LRed::callback->getGFXTopology().rasterConfig[0];
+    } else if (addr == mmPA_SC_RASTER_CONFIG_1) {
+        val = LRed::callback->getGFXTopology().rasterConfig1;
     }
     FunctionCast(wrapAMDHWRegsWrite, callback->orgAMDHWRegsWrite)(that, addr, val);
+    callback->trackDoorbellState(that, addr, val);
 }
 
 uint64_t X4000::wrapWriteData(void *that, const UInt32 *data, UInt32 size) {
@@ -300,12 +411,40 @@ uint64_t X4000::wrapWriteData(void *that, const UInt32 *data, UInt32 size) {
     return FunctionCast(wrapWriteData, callback->orgWriteData)(that, data, size);
 }
 
+bool isInPerformClearState = false;
+
 bool X4000::wrapHWRingWrite(void *that, UInt32 data) {
     SYSLOG("X4000", "IAMDHWRing WRITE --- DATA: 0x%x", data);
+    if (isInPerformClearState) { data = callback->patchClearStateDword(data); }
     return FunctionCast(wrapHWRingWrite, callback->orgHWRingWrite)(that, data);
 }
 
-bool isInPerformClearState = false;
+//! PA_SC_RASTER_CONFIG is a context register, the clear state's SET_CONTEXT_REG sets its default and overrides the
+//! MMIO write in `programRasterConfig`. Like amdgpu's gfx_v7_0_get_csb_buffer, it gets SE 0's value.
+UInt32 X4000::patchClearStateDword(UInt32 data) {
+    auto &state = this->clearState;
+    if (!state.remaining) {
+        UInt32 type = data >> 30;
+        state.remaining = (type == 0 || type == 3) ? ((data >> 16) & 0x3FFF) + 1 : 0;
+        state.opcode = type == 3 ? (data >> 8) & 0xFF : 0;
+        state.reg = 0;
+        return data;
+    }
+    state.remaining--;
+    if (state.opcode != PACKET3_SET_CONTEXT_REG) { return data; }
+    if (!state.reg) {
+        state.reg = PACKET3_SET_CONTEXT_REG_START + data;
+        return data;
+    }
+    UInt32 reg = state.reg++;
+    if (reg == mmPA_SC_RASTER_CONFIG) {
+        state.rasterConfigPatched = true;
+        return LRed::callback->getGFXTopology().rasterConfig[0];
+    } else if (reg == mmPA_SC_RASTER_CONFIG_1) {
+        return LRed::callback->getGFXTopology().rasterConfig1;
+    }
+    return data;
+}
 
 enum HWMemoryFields {
     VRAMMCBaseAddress = 0x50,
@@ -316,6 +455,7 @@ enum HWMemoryFields {
 /* To follow up on: https://github.com/ROCm/ROCK-Kernel-Driver/blob/8809b4b2efdcb6eb0a9b7fbb9e11ae5f83b3a8fa/drivers/gpu/drm/amd/amdgpu/gfx_v7_0.c#L2449 */
 
 bool X4000::performClearState(void *that) {
+    callback->clearState = {};
     isInPerformClearState = true;
     DBGLOG("X4000", "mmVM_CONTEXT0_PAGE_TABLE_START_ADDR = 0x%x",
         LRed::callback->readReg32(mmVM_CONTEXT0_PAGE_TABLE_START_ADDR));
@@ -340,8 +480,11 @@ bool X4000::performClearState(void *that) {
         //! TODO: find out if we need to inject sharedaper
         SYSLOG("X4000", "HWMem: sharedaper: 0x%llx", getMember<UInt64>(callback->hwMemPtr, HWMemoryFields::SharedApertureBaseAddr));
     }
+    LRed::callback->programRasterConfig();
     auto ret = FunctionCast(performClearState, callback->orgPerformClearState)(that);
     isInPerformClearState = false;
+    SYSLOG_COND(!callback->clearState.rasterConfigPatched, "X4000",
+        "The clear state didn't go through IAMDHWRing::write, its PA_SC_RASTER_CONFIG is X4000's");
     return ret;
 }
 
@@ -382,10 +525,14 @@ bool X4000::wrapGetRangeInfo(void *that, int memType, void *outData) {
     auto ret = FunctionCast(wrapGetRangeInfo, callback->orgGetRangeInfo)(that, memType, outData);
     DBGLOG("X4000", "getRangeInfo - off 0x0: 0x%llx - off 0x8: 0x%llx - off 0x10: 0x%llx",
         getMember<UInt64>(outData, 0x0), getMember<UInt64>(outData, 0x8), getMember<UInt64>(outData, 0x10));
+    //! Page numbers, what context 0 maps has to cover the range handed out here
+    DBGLOG("X4000", "getRangeInfo - VM_CONTEXT0_PAGE_TABLE_START_ADDR: 0x%x - VM_CONTEXT0_PAGE_TABLE_END_ADDR: 0x%x",
+        LRed::callback->readReg32(mmVM_CONTEXT0_PAGE_TABLE_START_ADDR),
+        LRed::callback->readReg32(mmVM_CONTEXT0_PAGE_TABLE_END_ADDR));
     if (memType == kAMDMemoryRangeTypeGART) {
         //! So... this stopped the page faulting. But the PM4 remains hung. What am I missing?
         getMember<UInt64>(outData, 0x0) = APU_COMMON_GART_PADDR; //! same as before
-        getMember<UInt64>(outData, 0x8) = CIK_DEFAULT_GART_SIZE;
+        getMember<UInt64>(outData, 0x8) = LRed::callback->gartSize;
     }
     return ret;
 }
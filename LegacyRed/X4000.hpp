@@ -8,11 +8,38 @@
 #include <Headers/kern_util.hpp>
 #include <IOKit/IOService.h>
 
+//! Mirrors `ADDR_REGISTER_VALUE` and `ADDR_CREATE_INPUT` from Mesa's addrinterface.h
+struct AddrRegisterValue {
+    UInt32 gbAddrConfig;
+    UInt32 backendDisables;
+    UInt32 noOfBanks;
+    UInt32 noOfRanks;
+    const UInt32 *tileConfig;
+    UInt32 noOfEntries;
+    const UInt32 *macroTileConfig;
+    UInt32 noOfMacroEntries;
+};
+
+struct AddrCreateInput {
+    UInt32 size;
+    UInt32 chipEngine;
+    UInt32 chipFamily;
+    UInt32 chipRevision;
+    void *allocSysMem;
+    void *freeSysMem;
+    void *debugPrint;
+    UInt32 createFlags;
+    AddrRegisterValue regValue;
+    void *client;
+    UInt32 minPitchAlignPixels;
+};
+
 class X4000 {
     public:
     static X4000 *callback;
     void init();
     bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void resetDoorbells();
 
     private:
     mach_vm_address_t orgAccelStart {0};
@@ -37,6 +64,16 @@ class X4000 {
     void *callbackAccelerator = nullptr;
     UInt64 mcLocation;
     bool dumpIBs {false};
+    IOMemoryMap *doorbellMap {nullptr};
+    volatile UInt32 *doorbellPtr {nullptr};
+    UInt32 doorbellsProgrammed {0};    //! Bitmask over `doorbellRings`, set on ring init
+    //! PM4 parser state for the clear state going through IAMDHWRing::write, one dword at a time
+    struct {
+        UInt32 remaining;    //! Payload dwords left in the current packet
+        UInt32 opcode;
+        UInt32 reg;    //! Next register of a SET_CONTEXT_REG, 0 until the offset dword has been seen
+        bool rasterConfigPatched;
+    } clearState {};
 
     static bool wrapAccelStart(void *that, IOService *provider);
     static void *wrapGetHWChannel(void *that, UInt32 engineType, UInt32 ringId);
@@ -49,8 +86,11 @@ class X4000 {
     static int wrapHwlInitGlobalParams(void *that, const void *creationInfo);
     static IOReturn wrapGetHWInfo(void *ctx, void *hwInfo);
     static void wrapAMDHWRegsWrite(void *that, UInt32 addr, UInt32 val);
+    bool ringDoorbell(UInt32 addr, UInt32 val);
+    void trackDoorbellState(void *hwRegs, UInt32 addr, UInt32 val);
     static uint64_t wrapWriteData(void *that, const UInt32 *data, UInt32 size);
     static bool wrapHWRingWrite(void *that, UInt32 data);
+    UInt32 patchClearStateDword(UInt32 data);
     static UInt32 wrapSubmitCommandBufferInfo(void *that, UInt8 *data);
     static UInt64 wrapBuildIBCommand(void *that, UInt32 *rawPkt, UInt64 param2, UInt32 param3, UInt64 ibType,
         UInt32 param5, bool param6, UInt32 param7);
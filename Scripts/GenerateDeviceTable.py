@@ -0,0 +1,198 @@
+#!/usr/bin/python3
+
+import os
+import re
+import sys
+
+header = '''
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5. See LICENSE for
+//  details.
+
+//! Generated by Scripts/GenerateDeviceTable.py from Devices.csv, do not edit.
+//! Only meant to be included by DeviceDB.hpp.
+#pragma once
+'''
+
+families = {"KV": "AMDGPU_FAMILY_KV", "CZ": "AMDGPU_FAMILY_CZ"}
+revision_sources = {"straps": "RevisionSource::Straps", "smu": "RevisionSource::SMU", "none": "RevisionSource::None"}
+power_gating = {"gfx": "PowerGatingGfx", "smg": "PowerGatingGfxStaticMG", "pipeline": "PowerGatingGfxPipeline",
+                "cp": "PowerGatingCP", "uvd": "PowerGatingUVD", "vce": "PowerGatingVCE"}
+
+
+def fail(line_no, msg):
+    sys.exit(f"Devices.csv:{line_no}: {msg}")
+
+
+def parse_range(value, line_no):
+    try:
+        if "-" in value:
+            first, last = [int(v, 16) for v in value.split("-")]
+        else:
+            first = last = int(value, 16)
+    except ValueError:
+        fail(line_no, f"invalid range '{value}'")
+    if first > last:
+        fail(line_no, f"empty range '{value}'")
+    return first, last
+
+
+def check_overlaps(entries, key, what):
+    entries.sort(key=key)
+    for prev, cur in zip(entries, entries[1:]):
+        if key(cur)[:-1] == key(prev)[:-1] and key(cur)[-1] <= prev["last"]:
+            fail(cur["line"], f"{what} overlaps the one on line {prev['line']}")
+
+
+def parse_database(path):
+    chips, devices, straps, revs, skus, golden = [], [], [], [], {}, []
+    with open(path, "r") as src_file:
+        for line_no, line in enumerate(src_file, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            kind, _, rest = line.partition(",")
+            if kind == "chip":
+                name, family, gcn3, revision, vce, uvd, addr_config, raster_config, gating = rest.split(",")
+                if family not in families or revision not in revision_sources:
+                    fail(line_no, "invalid family or revision source")
+                gating = [] if gating == "-" else gating.split("|")
+                if any(feature not in power_gating for feature in gating):
+                    fail(line_no, f"invalid power gating features '{'|'.join(gating)}'")
+                chips.append({"name": name, "family": families[family], "gcn3": gcn3 == "1",
+                              "revision": revision_sources[revision], "vce": vce, "uvd": uvd,
+                              "addr_config": int(addr_config, 16), "raster_config": int(raster_config, 16),
+                              "gating": " | ".join(power_gating[v] for v in gating) or "0"})
+            elif kind == "device":
+                ids, chip, variant, enumerated, cus, rbs, fallback = rest.split(",", 6)
+                first, last = parse_range(ids, line_no)
+                if int(rbs, 16) not in [1, 2, 4]:
+                    fail(line_no, f"invalid RB count '{rbs}'")
+                devices.append({"line": line_no, "first": first, "last": last, "chip": chip, "variant": variant,
+                                "enumerated": int(enumerated, 16), "cus": int(cus, 16), "rbs": int(rbs, 16),
+                                "fallback": fallback})
+            elif kind == "straps":
+                chip, strap, variant, enumerated = rest.split(",")
+                straps.append({"line": line_no, "chip": chip, "first": int(strap, 16), "last": int(strap, 16),
+                               "variant": variant, "enumerated": int(enumerated, 16)})
+            elif kind == "revs":
+                device, revisions, variant, cus = rest.split(",")
+                first, last = parse_range(revisions, line_no)
+                revs.append({"line": line_no, "device": int(device, 16), "first": first, "last": last,
+                             "variant": variant, "cus": 0 if cus == "-" else int(cus, 16)})
+            elif kind == "sku":
+                device, revision, name = rest.split(",", 2)
+                key = (int(device, 16) << 8) | int(revision, 16)
+                if key in skus:
+                    fail(line_no, f"duplicate SKU {device}:{revision}")
+                skus[key] = name
+            elif kind == "golden":
+                chip, register, offset, mask, value = rest.split(",")
+                golden.append({"line": line_no, "chip": chip, "register": register, "offset": int(offset, 16),
+                               "mask": int(mask, 16), "value": int(value, 16)})
+            else:
+                fail(line_no, f"unknown record '{kind}'")
+
+    chip_names = [chip["name"] for chip in chips]
+    for entry in devices + straps + golden:
+        if entry["chip"] not in chip_names:
+            fail(entry["line"], f"unknown chip type '{entry['chip']}'")
+    check_overlaps(devices, lambda v: (v["first"],), "device range")
+    check_overlaps(straps, lambda v: (chip_names.index(v["chip"]), v["first"]), "straps entry")
+    check_overlaps(revs, lambda v: (v["device"], v["first"]), "revision range")
+    for key in skus:
+        if not any(d["first"] <= key >> 8 <= d["last"] for d in devices):
+            sys.exit(f"Devices.csv: SKU 0x{key >> 8:04X}:0x{key & 0xFF:02X} has no device entry")
+    seen = {}
+    for entry in golden:
+        key = (entry["chip"], entry["offset"])
+        if key in seen:
+            fail(entry["line"], f"{entry['register']} is already set on line {seen[key]}")
+        if not entry["mask"] or entry["offset"] == 0xFFFFFFFF:
+            fail(entry["line"], f"invalid golden setting for {entry['register']}")
+        seen[key] = entry["line"]
+    return chips, devices, straps, revs, skus, golden
+
+
+def check_personalities(fw_dir, devices):
+    known = set()
+    for file in sorted(os.listdir(fw_dir)):
+        if not file.endswith(".xml"):
+            continue
+        with open(os.path.join(fw_dir, file), "r") as xml_file:
+            content = xml_file.read()
+        for match in re.findall(r"<key>IOPCIMatch</key>\s*<string>([^<]*)</string>", content):
+            for token in match.split():
+                if not re.fullmatch(r"0x[0-9A-F]{4}1002", token):
+                    sys.exit(f"{file}: malformed IOPCIMatch entry '{token}'")
+                device = int(token[2:6], 16)
+                if not any(d["first"] <= device <= d["last"] for d in devices):
+                    sys.exit(f"{file}: IOPCIMatch entry '{token}' is not in Devices.csv")
+                known.add(device)
+    return known
+
+
+def generate(target_file, chips, devices, straps, revs, skus, golden):
+    lines: list[str] = header.splitlines(keepends=True)
+
+    lines.append("\nstatic constexpr ChipInfo deviceChips[] = {\n")
+    for chip in chips:
+        lines.append(f"    {{ChipType::{chip['name']}, {chip['family']}, {str(chip['gcn3']).lower()}, "
+                     f"{chip['revision']}, \"{chip['vce']}\", \"{chip['uvd']}\", 0x{chip['addr_config']:08X}, "
+                     f"0x{chip['raster_config']:X}, {chip['gating']}}},\n")
+    lines.append("};\n")
+
+    lines.append("\nstatic constexpr DeviceRangeInfo deviceRanges[] = {\n")
+    for dev in devices:
+        lines.append(f"    {{0x{dev['first']:04X}, 0x{dev['last']:04X}, ChipType::{dev['chip']}, "
+                     f"ChipVariant::{dev['variant']}, 0x{dev['enumerated']:02X}, {dev['cus']}, {dev['rbs']}, "
+                     f"\"{dev['fallback']}\"}},\n")
+    lines.append("};\n")
+
+    lines.append("\nstatic constexpr StrapsInfo deviceStraps[] = {\n")
+    for strap in straps:
+        lines.append(f"    {{ChipType::{strap['chip']}, 0x{strap['first']:02X}, ChipVariant::{strap['variant']}, "
+                     f"0x{strap['enumerated']:02X}}},\n")
+    lines.append("};\n")
+
+    lines.append("\nstatic constexpr RevisionRangeInfo deviceRevisionRanges[] = {\n")
+    for rev in revs:
+        variant = "Unknown" if rev["variant"] == "-" else rev["variant"]
+        lines.append(f"    {{0x{rev['device']:04X}, 0x{rev['first']:02X}, 0x{rev['last']:02X}, "
+                     f"ChipVariant::{variant}, {rev['cus']}}},\n")
+    lines.append("};\n")
+
+    lines.append("\nstatic constexpr SKUInfo deviceSKUs[] = {\n")
+    for key in sorted(skus):
+        lines.append(f"    {{0x{key:06X}, \"{skus[key]}\"}},\n")
+    lines.append("};\n")
+
+    # CAIL walks these until the all-ones terminator, so every chip with settings gets its own array
+    for chip in chips:
+        settings = [entry for entry in golden if entry["chip"] == chip["name"]]
+        if not settings:
+            continue
+        lines.append(f"\nstatic const CAILASICGoldenRegisterSettings goldenRegisters{chip['name']}[] = {{\n")
+        for entry in settings:
+            lines.append(f"    {{0x{entry['offset']:04X}, 0x{entry['mask']:08X}, 0x{entry['value']:08X}}},"
+                         f"    //! {entry['register']}\n")
+        lines.append("    {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},\n};\n")
+
+    lines.append("\nstatic const CAILASICGoldenRegisterSettings *const deviceGoldenRegisters[] = {\n")
+    for chip in chips:
+        has_settings = any(entry["chip"] == chip["name"] for entry in golden)
+        lines.append(f"    {'goldenRegisters' + chip['name'] if has_settings else 'nullptr'},\n")
+    lines.append("};\n")
+
+    os.makedirs(os.path.dirname(target_file), exist_ok=True)
+    with open(target_file, "w") as file:
+        file.writelines(lines)
+
+
+if __name__ == '__main__':
+    database = parse_database(sys.argv[1])
+    if len(sys.argv) > 3:
+        matched = check_personalities(sys.argv[3], database[1])
+        for dev in database[1]:
+            if not any(dev["first"] <= v <= dev["last"] for v in matched):
+                print(f"warning: Devices.csv:{dev['line']}: no personality matches this device range")
+    generate(sys.argv[2], *database)